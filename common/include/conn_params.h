@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Adaptive connection parameter policy
+ */
+
+#ifndef CONN_PARAMS_H_
+#define CONN_PARAMS_H_
+
+#include <bluetooth/conn.h>
+
+/* Return true for the connections the policy applies to */
+typedef bool (*conn_params_filter_t)(struct bt_conn *conn);
+
+/* Register the connection callbacks. Call before bt_enable(). With a
+ * filter, other connections keep the parameters they were given, so links
+ * such as a configuration tool's do not take radio time from the remotes.
+ * NULL applies the policy to every connection.
+ */
+void conn_params_init(conn_params_filter_t filter);
+
+/* Note input activity on a connection, or on every connection if conn is
+ * NULL. Switches the link to the active parameters if it was idle and
+ * restarts the idle timer. Cheap enough to call for every button event.
+ */
+void conn_params_activity(struct bt_conn *conn);
+
+#endif /* CONN_PARAMS_H_ */
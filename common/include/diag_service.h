@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Diagnostics GATT service
+ *
+ *  One read and notify characteristic holding the device's counters as a
+ *  list of type, length, value records, values little endian. Link
+ *  records (RSSI, interval, PHY, ...) follow the DIAG_TLV_LINK record of
+ *  the link they describe. scripts/sc_diag.py reads and decodes it.
+ */
+
+#ifndef DIAG_SERVICE_H_
+#define DIAG_SERVICE_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+
+#define BT_UUID_SC_DIAG_SERVICE_VAL \
+	BT_UUID_128_ENCODE(0x5a3e0c10, 0x7b1f, 0x4d62, 0x8f0a, 0x1c9b2e6d4f80)
+#define BT_UUID_SC_DIAG_STATS_VAL \
+	BT_UUID_128_ENCODE(0x5a3e0c11, 0x7b1f, 0x4d62, 0x8f0a, 0x1c9b2e6d4f80)
+
+#define BT_UUID_SC_DIAG_SERVICE BT_UUID_DECLARE_128(BT_UUID_SC_DIAG_SERVICE_VAL)
+#define BT_UUID_SC_DIAG_STATS BT_UUID_DECLARE_128(BT_UUID_SC_DIAG_STATS_VAL)
+
+enum diag_tlv_type {
+	DIAG_TLV_UPTIME_MS		= 0x01,	/* u32 */
+
+	/* Button events */
+	DIAG_TLV_EVENTS			= 0x10,	/* u32, generated or decoded */
+	DIAG_TLV_EVENTS_SENT		= 0x11,	/* u32 */
+	DIAG_TLV_FRAMES			= 0x12,	/* u32, sent or received */
+	DIAG_TLV_TX_FAILED		= 0x13,	/* u32, notifications dropped */
+	DIAG_TLV_TX_RETRIES		= 0x14,	/* u32 */
+	DIAG_TLV_FRAMES_LOST		= 0x15,	/* u32 */
+	DIAG_TLV_RESYNCS		= 0x16,	/* u32 */
+
+	/* Queues and the HID endpoint */
+	DIAG_TLV_QUEUE_HWM		= 0x20,	/* u32, event ring or HID queue */
+	DIAG_TLV_QUEUE_OVERFLOWS	= 0x21,	/* u32 */
+	DIAG_TLV_HID_REPORTS		= 0x22,	/* u32 */
+	DIAG_TLV_HID_EP_BUSY		= 0x23,	/* u32, report found the endpoint busy */
+	DIAG_TLV_HID_DROPPED		= 0x24,	/* u32 */
+	DIAG_TLV_HID_EP_TIMEOUTS	= 0x25,	/* u32 */
+
+	DIAG_TLV_CONNECTS		= 0x30,	/* u32 */
+
+	/* The remote's own records, forwarded to the dongle, after the
+	 * DIAG_TLV_LINK record of the remote
+	 */
+	DIAG_TLV_REMOTE			= 0x50,	/* records */
+
+	/* Per link, after the DIAG_TLV_LINK record */
+	DIAG_TLV_LINK			= 0x40,	/* u8, link index */
+	DIAG_TLV_RSSI			= 0x41,	/* s8, dBm */
+	DIAG_TLV_CONN_INTERVAL		= 0x42,	/* u16, 1.25 ms units */
+	DIAG_TLV_PHY			= 0x43,	/* u8 tx, u8 rx */
+	DIAG_TLV_MTU			= 0x44,	/* u16 */
+	DIAG_TLV_DATA_LEN		= 0x45,	/* u16 tx, u16 rx */
+};
+
+struct diag_buf {
+	uint8_t *data;
+	uint16_t len;
+	uint16_t size;
+};
+
+/* Records that don't fit are left out */
+void diag_put_u8(struct diag_buf *buf, uint8_t type, uint8_t value);
+void diag_put_u16(struct diag_buf *buf, uint8_t type, uint16_t value);
+void diag_put_u32(struct diag_buf *buf, uint8_t type, uint32_t value);
+void diag_put_bytes(struct diag_buf *buf, uint8_t type, const uint8_t *data, uint8_t len);
+
+/* DIAG_TLV_LINK and the link records for one connection. The RSSI is the
+ * one read by the last diag_rssi_update().
+ */
+void diag_put_link(struct diag_buf *buf, uint8_t index, struct bt_conn *conn);
+
+/* Read the RSSI of every connection, one blocking HCI command each. Not to
+ * be called from the BT RX thread.
+ */
+void diag_rssi_update(void);
+
+/* Called to build the characteristic value, from the system workqueue while
+ * notifications are enabled, or from the Bluetooth RX thread on a read
+ */
+typedef void (*diag_fill_t)(struct diag_buf *buf);
+
+/* The value is built on every read, and refreshed and notified every
+ * CONFIG_SC_DIAG_INTERVAL_MS while a client is subscribed
+ */
+void diag_service_init(diag_fill_t fill);
+
+#endif /* DIAG_SERVICE_H_ */
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Latency histogram
+ *
+ *  Samples are in microseconds and sorted into logarithmic buckets with
+ *  four sub-buckets per power of two, so percentiles are accurate to
+ *  within 25 % over the whole range while adding a sample stays O(1).
+ */
+
+#ifndef LATENCY_HIST_H_
+#define LATENCY_HIST_H_
+
+#include <zephyr/types.h>
+
+#define LATENCY_HIST_SUB_BITS	2
+/* Covers samples up to 2^24 us (about 16 s), anything longer is clamped */
+#define LATENCY_HIST_MAX_EXP	23
+#define LATENCY_HIST_BUCKETS \
+	((LATENCY_HIST_MAX_EXP - LATENCY_HIST_SUB_BITS + 2) << LATENCY_HIST_SUB_BITS)
+
+struct latency_hist {
+	uint32_t count;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t bucket[LATENCY_HIST_BUCKETS];
+};
+
+void latency_hist_add(struct latency_hist *hist, uint32_t us);
+
+/* Upper bound of the bucket holding the given percentile, capped at max. */
+uint32_t latency_hist_percentile(const struct latency_hist *hist,
+				 uint32_t percent);
+
+static inline uint32_t latency_hist_mean(const struct latency_hist *hist)
+{
+	return hist->count ? (uint32_t)(hist->sum / hist->count) : 0;
+}
+
+void latency_hist_reset(struct latency_hist *hist);
+
+#endif /* LATENCY_HIST_H_ */
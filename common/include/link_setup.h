@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief LE 2M PHY and data length negotiation
+ */
+
+#ifndef LINK_SETUP_H_
+#define LINK_SETUP_H_
+
+#include <bluetooth/conn.h>
+
+struct link_setup_info {
+	uint8_t tx_phy;
+	uint8_t rx_phy;
+	uint16_t tx_len;
+	uint16_t rx_len;
+	uint16_t mtu;
+};
+
+struct link_setup_stats {
+	/* Links that switched to 2M, and peers that refused it */
+	uint32_t phy_2m;
+	uint32_t phy_refused;
+	/* Links that got a longer data length, and updates that failed */
+	uint32_t data_len;
+	uint32_t data_len_refused;
+};
+
+/* Register the connection callbacks. Call before bt_enable(). */
+void link_setup_init(void);
+
+/* PHY, data length and ATT MTU currently in use on a connection */
+int link_setup_info_get(struct bt_conn *conn, struct link_setup_info *info);
+
+void link_setup_stats_get(struct link_setup_stats *stats);
+
+#endif /* LINK_SETUP_H_ */
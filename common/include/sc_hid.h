@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief HID reports shared by the dongle and the HID over GATT remote
+ *
+ *  Both send the same keyboard and consumer control reports, so a host
+ *  sees the same device whichever way the remote is connected.
+ */
+
+#ifndef SC_HID_H_
+#define SC_HID_H_
+
+#define SC_HID_REPORT_ID_KBD		0x01
+#define SC_HID_REPORT_ID_CONS_CTRL	0x02
+
+/* Report sizes, not counting the report ID */
+#define SC_HID_KBD_ROLLOVER		6
+#define SC_HID_KBD_REPORT_SIZE		(2 + SC_HID_KBD_ROLLOVER)
+#define SC_HID_CONS_CTRL_SLOTS		4
+#define SC_HID_CONS_CTRL_REPORT_SIZE	(2 * SC_HID_CONS_CTRL_SLOTS)
+
+/* Consumer page usages, sent as little endian 16 bit values */
+#define SC_HID_CONS_POWER		0x0030
+#define SC_HID_CONS_RESET		0x0031
+#define SC_HID_CONS_SLEEP		0x0032
+#define SC_HID_CONS_SCAN_NEXT_TRACK	0x00B5
+#define SC_HID_CONS_SCAN_PREV_TRACK	0x00B6
+#define SC_HID_CONS_PLAY_PAUSE		0x00CD
+#define SC_HID_CONS_MUTE		0x00E2
+#define SC_HID_CONS_VOLUME_UP		0x00E9
+#define SC_HID_CONS_VOLUME_DOWN		0x00EA
+#define SC_HID_CONS_AC_BACK		0x0224
+#define SC_HID_CONS_AC_FORWARD		0x0225
+#define SC_HID_CONS_USAGE_MAX		0x03FF
+
+/* Keyboard collection up to and including the modifier byte */
+#define SC_HID_REPORT_DESC_KBD_START					\
+	0x05, 0x01,		/* Usage Page (Generic Desktop) */	\
+	0x09, 0x06,		/* Usage (Keyboard) */			\
+	0xA1, 0x01,		/* Collection (Application) */		\
+	0x85, SC_HID_REPORT_ID_KBD, /* Report ID 1 */			\
+	0x05, 0x07,		/* Usage Page (Key Codes) */		\
+	0x19, 0xe0,		/* Usage Minimum (224) */		\
+	0x29, 0xe7,		/* Usage Maximum (231) */		\
+	0x15, 0x00,		/* Logical Minimum (0) */		\
+	0x25, 0x01,		/* Logical Maximum (1) */		\
+	0x75, 0x01,		/* Report Size (1) */			\
+	0x95, 0x08,		/* Report Count (8) */			\
+	0x81, 0x02		/* Input (Data, Variable, Absolute) */
+
+/* Reserved byte and the boot compatible six key array */
+#define SC_HID_REPORT_DESC_KBD_KEYS					\
+	0x95, 0x01,		/* Report Count (1) */			\
+	0x75, 0x08,		/* Report Size (8) */			\
+	0x81, 0x01,		/* Input (Constant) reserved byte(1) */	\
+	0x95, SC_HID_KBD_ROLLOVER, /* Report Count (6) */		\
+	0x75, 0x08,		/* Report Size (8) */			\
+	0x15, 0x00,		/* Logical Minimum (0) */		\
+	0x25, 0x65,		/* Logical Maximum (101) */		\
+	0x05, 0x07,		/* Usage Page (Key codes) */		\
+	0x19, 0x00,		/* Usage Minimum (0) */			\
+	0x29, 0x65,		/* Usage Maximum (101) */		\
+	0x81, 0x00		/* Input (Data, Array) Key array(6 bytes) */
+
+#define SC_HID_REPORT_DESC_KBD_END					\
+	0xC0			/* End Collection (Application) */
+
+/*
+ * Array of SC_HID_CONS_CTRL_SLOTS usages held at the same time, unused
+ * slots are 0. Any usage up to SC_HID_CONS_USAGE_MAX can be sent.
+ */
+#define SC_HID_REPORT_DESC_CONS_CTRL					\
+	0x05, 0x0C,		/* Usage Page (Consumer) */		\
+	0x09, 0x01,		/* Usage (Consumer Control) */		\
+	0xA1, 0x01,		/* Collection (Application) */		\
+	0x85, SC_HID_REPORT_ID_CONS_CTRL, /* Report Id (2) */		\
+	0x15, 0x00,		/* Logical Minimum (0) */		\
+	0x26, 0xFF, 0x03,	/* Logical Maximum (1023) */		\
+	0x19, 0x00,		/* Usage Minimum (0) */			\
+	0x2A, 0xFF, 0x03,	/* Usage Maximum (1023) */		\
+	0x75, 0x10,		/* Report Size (16) */			\
+	0x95, SC_HID_CONS_CTRL_SLOTS, /* Report Count (4) */		\
+	0x81, 0x00,		/* Input (Data, Array, Absolute) */	\
+	0xC0			/* End Collection */
+
+#endif /* SC_HID_H_ */
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Logging helpers
+ *
+ *  Bluetooth addresses are logged as plain integer arguments, so the
+ *  caller doesn't format a string or copy it with log_strdup(). The
+ *  formatting happens later in the log thread, or on the host with
+ *  dictionary based logging.
+ */
+
+#ifndef SC_LOG_H_
+#define SC_LOG_H_
+
+#include <bluetooth/addr.h>
+
+#define SC_ADDR_FMT "%02X:%02X:%02X:%02X:%02X:%02X (%s)"
+
+#define SC_ADDR_ARGS(addr)						\
+	(addr)->a.val[5], (addr)->a.val[4], (addr)->a.val[3],		\
+	(addr)->a.val[2], (addr)->a.val[1], (addr)->a.val[0],		\
+	((addr)->type == BT_ADDR_LE_PUBLIC) ? "public" : "random"
+
+#endif /* SC_LOG_H_ */
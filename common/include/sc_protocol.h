@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef __SC_PROTOCOL_H
+#define __SC_PROTOCOL_H
+
+#include <zephyr/types.h>
+#include <sys/util.h>
+
+/*
+ * Binary frame sent from the remote to the dongle over NUS:
+ *
+ *  | version | seq | timestamp (le16) | state (le16) | event 0 | ... | event n-1 |
+ *
+ * - version:   SC_PROTO_VERSION_BYTE. The top bit is always set, so a frame can
+ *              never be mistaken for the legacy two byte ASCII packets.
+ * - seq:       Incremented by one for every frame the remote sends, used by the
+ *              receiver to detect lost frames.
+ * - timestamp: Remote uptime in milliseconds when the frame was sent, truncated
+ *              to 16 bits.
+ * - state:     Bitmap of the buttons held down once all events in the frame
+ *              have been applied. Lets the receiver resync after a gap.
+ *
+ * Every event is a fixed size record, so the number of events is given by the
+ * frame length alone.
+ */
+
+#define SC_PROTO_VERSION		1
+#define SC_PROTO_VERSION_BYTE		(0xA0 | SC_PROTO_VERSION)
+
+#define SC_PROTO_MAX_BUTTONS		16
+
+#define SC_PROTO_EVT_BUTTON_MASK	0x0F
+#define SC_PROTO_EVT_PRESSED		BIT(7)
+
+/* Event ages are saturated to this value (milliseconds). */
+#define SC_PROTO_EVT_AGE_MAX		UINT8_MAX
+
+struct sc_proto_hdr {
+	uint8_t version;
+	uint8_t seq;
+	uint16_t timestamp;
+	uint16_t state;
+} __packed;
+
+struct sc_proto_evt {
+	/* Button number, with SC_PROTO_EVT_PRESSED set on a press. */
+	uint8_t button;
+	/* Milliseconds between the edge and the frame timestamp. */
+	uint8_t age;
+} __packed;
+
+#define SC_PROTO_HDR_SIZE		sizeof(struct sc_proto_hdr)
+#define SC_PROTO_EVT_SIZE		sizeof(struct sc_proto_evt)
+
+#define SC_PROTO_FRAME_SIZE(evt_count) \
+	(SC_PROTO_HDR_SIZE + (evt_count) * SC_PROTO_EVT_SIZE)
+
+#define SC_PROTO_MAX_EVENTS(payload_size) \
+	(((payload_size) - SC_PROTO_HDR_SIZE) / SC_PROTO_EVT_SIZE)
+
+/* Legacy frames are two ASCII characters: button ('0'..'3') and state ('0'/'1'). */
+#define SC_PROTO_LEGACY_SIZE		2
+
+/*
+ * Counters frame, sent by the remote every few seconds next to the button
+ * event frames:
+ *
+ *  | SC_PROTO_STATS_BYTE | records ... |
+ *
+ * The records are the remote's diagnostics records (diag_service.h), cut
+ * to the ATT MTU. They carry no sequence number and don't count as frames,
+ * the dongle only keeps the last ones received.
+ */
+#define SC_PROTO_STATS_BYTE		(0xC0 | SC_PROTO_VERSION)
+#define SC_PROTO_STATS_MAX_SIZE		96
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include <conn_params.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(conn_params, CONFIG_SC_LOG_LEVEL);
+
+#define IDLE_TIMEOUT K_MSEC(CONFIG_SC_CONN_PARAMS_IDLE_TIMEOUT_MS)
+
+BUILD_ASSERT(CONFIG_SC_CONN_PARAMS_SUPERVISION_TIMEOUT * 10 * 4 >
+	     (1 + CONFIG_SC_CONN_PARAMS_IDLE_LATENCY) *
+	     CONFIG_SC_CONN_PARAMS_IDLE_INTERVAL * 5 * 2,
+	     "Supervision timeout too short for the idle parameters");
+
+static const struct bt_le_conn_param active_param = {
+	.interval_min = CONFIG_SC_CONN_PARAMS_ACTIVE_INTERVAL,
+	.interval_max = CONFIG_SC_CONN_PARAMS_ACTIVE_INTERVAL,
+	.latency = CONFIG_SC_CONN_PARAMS_ACTIVE_LATENCY,
+	.timeout = CONFIG_SC_CONN_PARAMS_SUPERVISION_TIMEOUT,
+};
+
+static const struct bt_le_conn_param idle_param = {
+	.interval_min = CONFIG_SC_CONN_PARAMS_IDLE_INTERVAL,
+	.interval_max = CONFIG_SC_CONN_PARAMS_IDLE_INTERVAL,
+	.latency = CONFIG_SC_CONN_PARAMS_IDLE_LATENCY,
+	.timeout = CONFIG_SC_CONN_PARAMS_SUPERVISION_TIMEOUT,
+};
+
+struct conn_ctx {
+	struct bt_conn *conn;
+	/* Set while the active parameters are requested or in use */
+	atomic_t active;
+	uint32_t request_time;
+	struct k_work active_work;
+	struct k_work_delayable idle_work;
+};
+
+static struct conn_ctx conn_ctx[CONFIG_BT_MAX_CONN];
+static conn_params_filter_t conn_filter;
+
+static void param_request(struct conn_ctx *ctx,
+			  const struct bt_le_conn_param *param)
+{
+	struct bt_conn *conn = ctx->conn;
+	int err;
+
+	if (!conn) {
+		return;
+	}
+
+	ctx->request_time = k_uptime_get_32();
+
+	err = bt_conn_le_param_update(conn, param);
+	if (err && (err != -EALREADY)) {
+		LOG_WRN("Connection parameter update failed (err %d)", err);
+	}
+}
+
+static void active_work_handler(struct k_work *work)
+{
+	struct conn_ctx *ctx = CONTAINER_OF(work, struct conn_ctx, active_work);
+
+	LOG_DBG("Link active, requesting short interval");
+	param_request(ctx, &active_param);
+}
+
+static void idle_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct conn_ctx *ctx = CONTAINER_OF(dwork, struct conn_ctx, idle_work);
+
+	atomic_clear(&ctx->active);
+
+	LOG_DBG("Link idle, requesting long interval");
+	param_request(ctx, &idle_param);
+}
+
+static void ctx_activity(struct conn_ctx *ctx)
+{
+	k_work_reschedule(&ctx->idle_work, IDLE_TIMEOUT);
+
+	if (atomic_cas(&ctx->active, 0, 1)) {
+		k_work_submit(&ctx->active_work);
+	}
+}
+
+void conn_params_activity(struct bt_conn *conn)
+{
+	if (conn) {
+		struct conn_ctx *ctx = &conn_ctx[bt_conn_index(conn)];
+
+		if (ctx->conn == conn) {
+			ctx_activity(ctx);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(conn_ctx); i++) {
+		if (conn_ctx[i].conn) {
+			ctx_activity(&conn_ctx[i]);
+		}
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct conn_ctx *ctx = &conn_ctx[bt_conn_index(conn)];
+
+	if (err || (conn_filter && !conn_filter(conn))) {
+		return;
+	}
+
+	ctx->conn = bt_conn_ref(conn);
+	atomic_clear(&ctx->active);
+
+	/* Start out fast, discovery and the first keypress benefit from it */
+	ctx_activity(ctx);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct conn_ctx *ctx = &conn_ctx[bt_conn_index(conn)];
+	struct k_work_sync sync;
+
+	if (ctx->conn != conn) {
+		return;
+	}
+
+	k_work_cancel_sync(&ctx->active_work, &sync);
+	k_work_cancel_delayable_sync(&ctx->idle_work, &sync);
+
+	bt_conn_unref(ctx->conn);
+	ctx->conn = NULL;
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	struct conn_ctx *ctx = &conn_ctx[bt_conn_index(conn)];
+	uint32_t interval_us = interval * 1250U;
+
+	if (ctx->conn != conn) {
+		return;
+	}
+
+	if (ctx->request_time) {
+		LOG_INF("Conn params: interval %u.%02u ms, latency %u, "
+			"timeout %u ms (%u ms after request)",
+			interval_us / 1000U, (interval_us % 1000U) / 10U,
+			latency, timeout * 10U,
+			k_uptime_get_32() - ctx->request_time);
+		ctx->request_time = 0;
+	} else {
+		LOG_INF("Conn params: interval %u.%02u ms, latency %u, "
+			"timeout %u ms (peer initiated)",
+			interval_us / 1000U, (interval_us % 1000U) / 10U,
+			latency, timeout * 10U);
+	}
+}
+
+static struct bt_conn_cb conn_callbacks = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
+
+void conn_params_init(conn_params_filter_t filter)
+{
+	conn_filter = filter;
+
+	for (size_t i = 0; i < ARRAY_SIZE(conn_ctx); i++) {
+		k_work_init(&conn_ctx[i].active_work, active_work_handler);
+		k_work_init_delayable(&conn_ctx[i].idle_work,
+				      idle_work_handler);
+	}
+
+	bt_conn_cb_register(&conn_callbacks);
+}
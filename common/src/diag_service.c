@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/byteorder.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/hci.h>
+
+#include <diag_service.h>
+#if defined(CONFIG_SC_LINK_SETUP)
+#include <link_setup.h>
+#endif
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(diag_service, CONFIG_SC_LOG_LEVEL);
+
+#define VALUE_SIZE CONFIG_SC_DIAG_VALUE_SIZE
+#define REFRESH_INTERVAL K_MSEC(CONFIG_SC_DIAG_INTERVAL_MS)
+
+/* RSSI needs a blocking HCI round trip, so it is never read on the BT RX
+ * thread, which also carries the input. It is read from the system workqueue
+ * on every refresh while notifications are enabled, and after a read so that
+ * the next one gets a recent value. Reads are served from the cache.
+ */
+#define RSSI_UNKNOWN 127
+static int8_t rssi[CONFIG_BT_MAX_CONN];
+
+static diag_fill_t diag_fill;
+static bool notify_enabled;
+
+static uint8_t value[VALUE_SIZE];
+static uint16_t value_len;
+static K_MUTEX_DEFINE(value_mutex);
+
+static void refresh_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(refresh_work, refresh_work_handler);
+
+static void rssi_work_handler(struct k_work *work);
+static K_WORK_DEFINE(rssi_work, rssi_work_handler);
+
+static bool diag_put(struct diag_buf *buf, uint8_t type, uint8_t len)
+{
+	if ((buf->len + 2 + len) > buf->size) {
+		return false;
+	}
+
+	buf->data[buf->len++] = type;
+	buf->data[buf->len++] = len;
+	return true;
+}
+
+void diag_put_u8(struct diag_buf *buf, uint8_t type, uint8_t value)
+{
+	if (diag_put(buf, type, sizeof(value))) {
+		buf->data[buf->len++] = value;
+	}
+}
+
+void diag_put_u16(struct diag_buf *buf, uint8_t type, uint16_t value)
+{
+	if (diag_put(buf, type, sizeof(value))) {
+		sys_put_le16(value, &buf->data[buf->len]);
+		buf->len += sizeof(value);
+	}
+}
+
+void diag_put_u32(struct diag_buf *buf, uint8_t type, uint32_t value)
+{
+	if (diag_put(buf, type, sizeof(value))) {
+		sys_put_le32(value, &buf->data[buf->len]);
+		buf->len += sizeof(value);
+	}
+}
+
+void diag_put_bytes(struct diag_buf *buf, uint8_t type, const uint8_t *data, uint8_t len)
+{
+	if (diag_put(buf, type, len)) {
+		memcpy(&buf->data[buf->len], data, len);
+		buf->len += len;
+	}
+}
+
+void diag_put_link(struct diag_buf *buf, uint8_t index, struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	if (!conn || bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	diag_put_u8(buf, DIAG_TLV_LINK, index);
+	diag_put_u8(buf, DIAG_TLV_RSSI, (uint8_t)rssi[bt_conn_index(conn)]);
+	diag_put_u16(buf, DIAG_TLV_CONN_INTERVAL, info.le.interval);
+
+#if defined(CONFIG_SC_LINK_SETUP)
+	struct link_setup_info link;
+
+	if (!link_setup_info_get(conn, &link)) {
+		diag_put_u16(buf, DIAG_TLV_PHY, link.tx_phy | (link.rx_phy << 8));
+		diag_put_u16(buf, DIAG_TLV_MTU, link.mtu);
+		diag_put_u32(buf, DIAG_TLV_DATA_LEN, link.tx_len | ((uint32_t)link.rx_len << 16));
+	}
+#else
+	diag_put_u16(buf, DIAG_TLV_MTU, bt_gatt_get_mtu(conn));
+#endif
+}
+
+static void rssi_read(struct bt_conn *conn, void *data)
+{
+	struct bt_hci_cp_read_rssi *cp;
+	struct bt_hci_rp_read_rssi *rp;
+	struct net_buf *buf, *rsp = NULL;
+	uint16_t handle;
+	int err;
+
+	rssi[bt_conn_index(conn)] = RSSI_UNKNOWN;
+
+	if (bt_hci_get_conn_handle(conn, &handle)) {
+		return;
+	}
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_READ_RSSI, sizeof(*cp));
+	if (!buf) {
+		return;
+	}
+
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle = sys_cpu_to_le16(handle);
+
+	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_RSSI, buf, &rsp);
+	if (err) {
+		LOG_DBG("RSSI read failed (err %d)", err);
+		return;
+	}
+
+	rp = (void *)rsp->data;
+	rssi[bt_conn_index(conn)] = rp->rssi;
+	net_buf_unref(rsp);
+}
+
+void diag_rssi_update(void)
+{
+	bt_conn_foreach(BT_CONN_TYPE_LE, rssi_read, NULL);
+}
+
+static void rssi_work_handler(struct k_work *work)
+{
+	diag_rssi_update();
+}
+
+/* Called with the value mutex held */
+static void value_update(void)
+{
+	struct diag_buf buf = {
+		.data = value,
+		.size = sizeof(value),
+	};
+
+	diag_put_u32(&buf, DIAG_TLV_UPTIME_MS, k_uptime_get_32());
+	diag_fill(&buf);
+	value_len = buf.len;
+}
+
+static ssize_t stats_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  void *buf, uint16_t len, uint16_t offset)
+{
+	ssize_t ret;
+
+	k_mutex_lock(&value_mutex, K_FOREVER);
+	/* The rest of a long read comes from the same value */
+	if ((offset == 0) && diag_fill) {
+		value_update();
+		k_work_submit(&rssi_work);
+	}
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, value, value_len);
+	k_mutex_unlock(&value_mutex);
+
+	return ret;
+}
+
+static void stats_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+
+	/* Without subscribers the refresh stops by itself */
+	if (notify_enabled) {
+		k_work_reschedule(&refresh_work, K_NO_WAIT);
+	}
+}
+
+BT_GATT_SERVICE_DEFINE(sc_diag_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_SC_DIAG_SERVICE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_SC_DIAG_STATS,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_READ, stats_read, NULL, NULL),
+	BT_GATT_CCC(stats_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+);
+
+static void refresh_work_handler(struct k_work *work)
+{
+	static uint8_t scratch[VALUE_SIZE];
+	uint16_t len;
+
+	if (!notify_enabled || !diag_fill) {
+		return;
+	}
+
+	diag_rssi_update();
+
+	k_mutex_lock(&value_mutex, K_FOREVER);
+	value_update();
+	memcpy(scratch, value, value_len);
+	len = value_len;
+	k_mutex_unlock(&value_mutex);
+
+	bt_gatt_notify(NULL, &sc_diag_svc.attrs[1], scratch, len);
+
+	k_work_schedule(&refresh_work, REFRESH_INTERVAL);
+}
+
+void diag_service_init(diag_fill_t fill)
+{
+	memset(rssi, RSSI_UNKNOWN, sizeof(rssi));
+	diag_fill = fill;
+
+	/* In case a client subscribed already */
+	k_work_reschedule(&refresh_work, K_NO_WAIT);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <sys/util.h>
+
+#include <latency_hist.h>
+
+#define SUB_BUCKETS	BIT(LATENCY_HIST_SUB_BITS)
+#define SUB_MASK	(SUB_BUCKETS - 1)
+
+static uint32_t bucket_index(uint32_t us)
+{
+	uint32_t exp;
+	uint32_t idx;
+
+	if (us < SUB_BUCKETS) {
+		return us;
+	}
+
+	exp = 31 - __builtin_clz(us);
+	idx = ((exp - LATENCY_HIST_SUB_BITS + 1) << LATENCY_HIST_SUB_BITS) |
+	      ((us >> (exp - LATENCY_HIST_SUB_BITS)) & SUB_MASK);
+
+	return MIN(idx, LATENCY_HIST_BUCKETS - 1);
+}
+
+static uint32_t bucket_upper_bound(uint32_t idx)
+{
+	uint32_t exp;
+	uint32_t mant;
+
+	if (idx < SUB_BUCKETS) {
+		return idx;
+	}
+
+	exp = (idx >> LATENCY_HIST_SUB_BITS) + LATENCY_HIST_SUB_BITS - 1;
+	mant = SUB_BUCKETS | (idx & SUB_MASK);
+
+	return ((mant + 1) << (exp - LATENCY_HIST_SUB_BITS)) - 1;
+}
+
+void latency_hist_add(struct latency_hist *hist, uint32_t us)
+{
+	hist->bucket[bucket_index(us)]++;
+	hist->count++;
+	hist->sum += us;
+
+	if (us > hist->max) {
+		hist->max = us;
+	}
+}
+
+uint32_t latency_hist_percentile(const struct latency_hist *hist,
+				 uint32_t percent)
+{
+	uint32_t target;
+	uint32_t seen = 0;
+
+	if (hist->count == 0) {
+		return 0;
+	}
+
+	/* Rank of the sample, rounded up so p100 is the last sample */
+	target = (uint32_t)(((uint64_t)hist->count * percent + 99) / 100);
+
+	for (uint32_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= target) {
+			return MIN(bucket_upper_bound(i), hist->max);
+		}
+	}
+
+	return hist->max;
+}
+
+void latency_hist_reset(struct latency_hist *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
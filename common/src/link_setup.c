@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+#include <link_setup.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(link_setup, CONFIG_SC_LOG_LEVEL);
+
+/* Longest PDU time on the 1M PHY, so the request holds on either PHY */
+#define DATA_TIME_1M(len) (((len) + 14) * 8)
+
+/* Give up on a PHY update the peer never answers */
+#define PHY_UPDATE_TIMEOUT K_SECONDS(2)
+
+struct link_ctx {
+	struct bt_conn *conn;
+	struct link_setup_info info;
+	struct k_work_delayable work;
+	bool phy_requested;
+	bool phy_done;
+	bool data_len_done;
+};
+
+static struct link_ctx link_ctx[CONFIG_BT_MAX_CONN];
+
+/* Peers that refused 2M are not asked again when they reconnect */
+static bt_addr_le_t refused_2m[CONFIG_SC_LINK_SETUP_REFUSED_CACHE];
+static size_t refused_2m_next;
+
+static struct {
+	atomic_t phy_2m;
+	atomic_t phy_refused;
+	atomic_t data_len;
+	atomic_t data_len_refused;
+} stats;
+
+static const char *phy_name(uint8_t phy)
+{
+	switch (phy) {
+	case BT_GAP_LE_PHY_1M:
+		return "1M";
+	case BT_GAP_LE_PHY_2M:
+		return "2M";
+	case BT_GAP_LE_PHY_CODED:
+		return "coded";
+	default:
+		return "?";
+	}
+}
+
+static bool peer_refused_2m(const bt_addr_le_t *addr)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(refused_2m); i++) {
+		if (!bt_addr_le_cmp(&refused_2m[i], addr)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void phy_refused(struct link_ctx *ctx)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(ctx->conn);
+
+	LOG_INF("Peer stays on the %s PHY", phy_name(ctx->info.tx_phy));
+	atomic_inc(&stats.phy_refused);
+
+	if (!peer_refused_2m(addr)) {
+		bt_addr_le_copy(&refused_2m[refused_2m_next], addr);
+		refused_2m_next = (refused_2m_next + 1) % ARRAY_SIZE(refused_2m);
+	}
+}
+
+static void data_len_request(struct link_ctx *ctx)
+{
+	const struct bt_conn_le_data_len_param param = {
+		.tx_max_len = CONFIG_SC_LINK_SETUP_DATA_LEN,
+		.tx_max_time = DATA_TIME_1M(CONFIG_SC_LINK_SETUP_DATA_LEN),
+	};
+	int err;
+
+	ctx->data_len_done = true;
+
+	err = bt_conn_le_data_len_update(ctx->conn, &param);
+	if (err) {
+		/* Keep the default 27 octets, the link works without it */
+		LOG_WRN("Data length update failed (err %d)", err);
+		atomic_inc(&stats.data_len_refused);
+	}
+}
+
+/* PHY first, the data length update follows once it is settled */
+static void setup_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct link_ctx *ctx = CONTAINER_OF(dwork, struct link_ctx, work);
+	int err;
+
+	if (!ctx->conn) {
+		return;
+	}
+
+	if (ctx->phy_requested) {
+		/* Timed out waiting for the update */
+		ctx->phy_requested = false;
+		ctx->phy_done = true;
+		phy_refused(ctx);
+	}
+
+	if (IS_ENABLED(CONFIG_SC_LINK_SETUP_2M_PHY) && !ctx->phy_done) {
+		if (peer_refused_2m(bt_conn_get_dst(ctx->conn))) {
+			LOG_INF("Peer refused 2M before, not asking again");
+			ctx->phy_done = true;
+		} else {
+			err = bt_conn_le_phy_update(ctx->conn, BT_CONN_LE_PHY_PARAM_2M);
+			if (!err) {
+				ctx->phy_requested = true;
+				k_work_reschedule(&ctx->work, PHY_UPDATE_TIMEOUT);
+				return;
+			}
+
+			LOG_WRN("PHY update failed (err %d)", err);
+			ctx->phy_done = true;
+			phy_refused(ctx);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_SC_LINK_SETUP_DATA_LEN_UPDATE) && !ctx->data_len_done) {
+		data_len_request(ctx);
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	struct link_ctx *ctx = &link_ctx[bt_conn_index(conn)];
+	struct bt_conn_info info;
+
+	if (err || bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	ctx->conn = bt_conn_ref(conn);
+	ctx->phy_requested = false;
+	ctx->phy_done = false;
+	ctx->data_len_done = false;
+	ctx->info.tx_phy = info.le.phy->tx_phy;
+	ctx->info.rx_phy = info.le.phy->rx_phy;
+	ctx->info.tx_len = info.le.data_len->tx_max_len;
+	ctx->info.rx_len = info.le.data_len->rx_max_len;
+
+	/* The central leads, a peripheral only asks if it has not by then */
+	k_work_reschedule(&ctx->work, (info.role == BT_CONN_ROLE_CENTRAL) ? K_NO_WAIT :
+			  K_MSEC(CONFIG_SC_LINK_SETUP_PERIPHERAL_DELAY_MS));
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct link_ctx *ctx = &link_ctx[bt_conn_index(conn)];
+	struct k_work_sync sync;
+
+	if (ctx->conn != conn) {
+		return;
+	}
+
+	k_work_cancel_delayable_sync(&ctx->work, &sync);
+
+	bt_conn_unref(ctx->conn);
+	ctx->conn = NULL;
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	struct link_ctx *ctx = &link_ctx[bt_conn_index(conn)];
+
+	if (ctx->conn != conn) {
+		return;
+	}
+
+	ctx->info.tx_phy = param->tx_phy;
+	ctx->info.rx_phy = param->rx_phy;
+
+	LOG_INF("PHY: tx %s, rx %s", phy_name(param->tx_phy), phy_name(param->rx_phy));
+
+	if (param->tx_phy == BT_GAP_LE_PHY_2M) {
+		if (!ctx->phy_done) {
+			atomic_inc(&stats.phy_2m);
+		}
+		ctx->phy_done = true;
+	} else if (ctx->phy_requested) {
+		ctx->phy_done = true;
+		phy_refused(ctx);
+	}
+
+	if (ctx->phy_requested) {
+		ctx->phy_requested = false;
+		k_work_reschedule(&ctx->work, K_NO_WAIT);
+	}
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	struct link_ctx *ctx = &link_ctx[bt_conn_index(conn)];
+
+	if (ctx->conn != conn) {
+		return;
+	}
+
+	if ((info->tx_max_len > ctx->info.tx_len) && (ctx->info.tx_len <= BT_GAP_DATA_LEN_DEFAULT)) {
+		atomic_inc(&stats.data_len);
+	}
+
+	ctx->info.tx_len = info->tx_max_len;
+	ctx->info.rx_len = info->rx_max_len;
+
+	/* Done by the peer, nothing left to ask for */
+	if (info->tx_max_len >= CONFIG_SC_LINK_SETUP_DATA_LEN) {
+		ctx->data_len_done = true;
+	}
+
+	LOG_INF("Data length: tx %u octets %u us, rx %u octets %u us",
+		info->tx_max_len, info->tx_max_time,
+		info->rx_max_len, info->rx_max_time);
+}
+
+static void att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	LOG_INF("ATT MTU: tx %u, rx %u", tx, rx);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
+};
+
+static struct bt_gatt_cb gatt_callbacks = {
+	.att_mtu_updated = att_mtu_updated,
+};
+
+int link_setup_info_get(struct bt_conn *conn, struct link_setup_info *info)
+{
+	struct link_ctx *ctx = &link_ctx[bt_conn_index(conn)];
+
+	if (ctx->conn != conn) {
+		return -ENOTCONN;
+	}
+
+	*info = ctx->info;
+	info->mtu = bt_gatt_get_mtu(conn);
+	return 0;
+}
+
+void link_setup_stats_get(struct link_setup_stats *out)
+{
+	out->phy_2m = atomic_get(&stats.phy_2m);
+	out->phy_refused = atomic_get(&stats.phy_refused);
+	out->data_len = atomic_get(&stats.data_len);
+	out->data_len_refused = atomic_get(&stats.data_len_refused);
+}
+
+void link_setup_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(link_ctx); i++) {
+		k_work_init_delayable(&link_ctx[i].work, setup_work_handler);
+	}
+
+	bt_conn_cb_register(&conn_callbacks);
+	bt_gatt_cb_register(&gatt_callbacks);
+}
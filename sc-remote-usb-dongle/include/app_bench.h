@@ -0,0 +1,16 @@
+#ifndef __APP_BENCH_H
+#define __APP_BENCH_H
+
+#include <zephyr.h>
+
+#include "app_ble_nus_c_handler.h"
+
+/*
+ * Measure the decode and report path with synthetic remote frames, and log
+ * the results. The frames go through the same handlers as frames from a
+ * remote, using the last remote slot, which is reset afterwards. The pipeline
+ * part is skipped, or stopped, while a remote is connected in that slot.
+ */
+void app_bench_start(const app_ble_nus_c_config_t *handlers);
+
+#endif
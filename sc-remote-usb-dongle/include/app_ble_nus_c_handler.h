@@ -2,13 +2,28 @@
 #define __APP_BLE_NUS_C_HANDLER
 
 #include <zephyr.h>
+#include <bluetooth/conn.h>
 
-typedef void (*app_ble_nus_c_data_received_t)(uint8_t *data_ptr, uint32_t length);
+// Remotes are identified by their slot, 0 to CONFIG_SC_DONGLE_MAX_REMOTES - 1
+typedef void (*app_ble_nus_c_data_received_t)(uint8_t remote, const uint8_t *data_ptr, uint32_t length);
+
+typedef void (*app_ble_nus_c_disconnected_t)(uint8_t remote);
 
 typedef struct {
 	app_ble_nus_c_data_received_t on_data_received;
+	app_ble_nus_c_disconnected_t on_disconnected;
 } app_ble_nus_c_config_t;
 
 int app_ble_nus_c_init(app_ble_nus_c_config_t *config);
 
+// Connection of a remote slot, NULL if it is free. The connection is
+// referenced, release it with bt_conn_unref().
+struct bt_conn *app_ble_nus_c_conn_get(uint8_t remote);
+
+// Whether a remote slot holds a connection
+bool app_ble_nus_c_connected(uint8_t remote);
+
+// Remotes connected since boot, reconnections included
+uint32_t app_ble_nus_c_connect_count(void);
+
 #endif
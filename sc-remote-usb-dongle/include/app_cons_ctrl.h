@@ -0,0 +1,24 @@
+#ifndef __APP_CONS_CTRL_H
+#define __APP_CONS_CTRL_H
+
+#include <zephyr.h>
+
+// Sources and slots are the ones of app_kbd_state.h
+#include "app_kbd_state.h"
+
+/*
+ * Hold a 16-bit consumer usage in a slot of a source. The usages held by every
+ * source are merged into one array report, sent whenever the merged set
+ * changes. A usage held with repeat set is released and pressed again by the
+ * dongle while it is held, so the remote only sends the two edges.
+ */
+int app_cons_ctrl_press(uint8_t source, uint8_t slot, uint16_t usage, bool repeat);
+
+int app_cons_ctrl_release(uint8_t source, uint8_t slot);
+
+void app_cons_ctrl_release_all(uint8_t source);
+
+// Send the merged usages again, changed or not
+int app_cons_ctrl_refresh(void);
+
+#endif
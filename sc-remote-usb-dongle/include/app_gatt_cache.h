@@ -0,0 +1,30 @@
+#ifndef __APP_GATT_CACHE_H
+#define __APP_GATT_CACHE_H
+
+#include <zephyr.h>
+#include <bluetooth/addr.h>
+#include <bluetooth/services/nus_client.h>
+
+#define APP_GATT_CACHE_DB_HASH_LEN 16
+
+// Discovered NUS handles of a bonded remote, persisted in settings
+struct app_gatt_cache_entry {
+	bt_addr_le_t addr;
+	struct bt_nus_client_handles handles;
+	uint8_t db_hash[APP_GATT_CACHE_DB_HASH_LEN];
+	bool db_hash_valid;
+	bool in_use;
+};
+
+const struct app_gatt_cache_entry *app_gatt_cache_find(const bt_addr_le_t *addr);
+
+// db_hash may be NULL if the remote does not expose a Database Hash. The
+// entry applies right away, and is stored in settings from the system work
+// queue, as is the deletion of an invalidated one.
+int app_gatt_cache_store(const bt_addr_le_t *addr,
+			 const struct bt_nus_client_handles *handles,
+			 const uint8_t *db_hash);
+
+void app_gatt_cache_invalidate(const bt_addr_le_t *addr);
+
+#endif
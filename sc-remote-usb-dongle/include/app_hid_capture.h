@@ -0,0 +1,21 @@
+#ifndef __APP_HID_CAPTURE_H
+#define __APP_HID_CAPTURE_H
+
+#include <zephyr.h>
+#include <device.h>
+
+/*
+ * Stand-in for the USB HID IN endpoints on boards without USB, such as the
+ * simulated nrf52_bsim. A simulated host reads one report from each endpoint
+ * per polling interval and calls the ready callback, like the USB stack would.
+ */
+#define APP_HID_CAPTURE_EP_COUNT 2
+
+typedef void (*app_hid_capture_ready_t)(uint8_t ep);
+
+void app_hid_capture_init(app_hid_capture_ready_t in_ready_cb);
+
+// Same contract as hid_int_ep_write(), the endpoint must be free
+int app_hid_capture_write(uint8_t ep, const uint8_t *data, uint32_t size, uint32_t *bytes_ret);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __APP_KBD_STATE_H
+#define __APP_KBD_STATE_H
+
+#include <zephyr.h>
+
+#include <sc_protocol.h>
+
+// Input sources, each with its own set of held keys
+#define APP_KBD_SOURCE_LOCAL	0
+#define APP_KBD_SOURCE_MACRO	1
+#define APP_KBD_SOURCE_REMOTE(n)	(2 + (n))
+#define APP_KBD_SOURCE_COUNT	APP_KBD_SOURCE_REMOTE(CONFIG_SC_DONGLE_MAX_REMOTES)
+
+// Key slots per source, typically one per button
+#define APP_KBD_SLOT_COUNT		SC_PROTO_MAX_BUTTONS
+
+struct app_kbd_action {
+	uint8_t modifiers;
+	uint8_t key;
+};
+
+/*
+ * Press and release only update the pending state of a source. Nothing is
+ * sent until app_kbd_state_commit(), so every edge of a chord received
+ * together ends up in the same report.
+ */
+int app_kbd_state_press(uint8_t source, uint8_t slot, struct app_kbd_action action);
+
+int app_kbd_state_release(uint8_t source, uint8_t slot);
+
+void app_kbd_state_release_all(uint8_t source);
+
+// Publish the pending state of a source, and send a report if the merged state changed
+int app_kbd_state_commit(uint8_t source);
+
+// Send the merged state of every source again, changed or not
+int app_kbd_state_refresh(void);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __APP_KEYMAP_H
+#define __APP_KEYMAP_H
+
+#include <zephyr.h>
+
+#include <sc_protocol.h>
+
+// Every remote shares one map, the dongle's own buttons have another
+#define APP_KEYMAP_SOURCE_LOCAL		0
+#define APP_KEYMAP_SOURCE_REMOTE	1
+#define APP_KEYMAP_SOURCE_COUNT		2
+
+#define APP_KEYMAP_BUTTON_COUNT		SC_PROTO_MAX_BUTTONS
+
+#define APP_KEYMAP_EVT_PRESS		0
+#define APP_KEYMAP_EVT_RELEASE		1
+#define APP_KEYMAP_EVT_COUNT		2
+
+enum app_keymap_action_type {
+	APP_KEYMAP_ACTION_NONE,
+	// Hold modifiers and usage in the button's key slot
+	APP_KEYMAP_ACTION_KEY_PRESS,
+	// Release the button's key slot
+	APP_KEYMAP_ACTION_KEY_RELEASE,
+	// Hold the 16-bit consumer usage in the button's consumer slot, modifiers
+	// holds APP_KEYMAP_CONS_FLAG_*
+	APP_KEYMAP_ACTION_CONS_PRESS,
+	// Release the button's consumer slot
+	APP_KEYMAP_ACTION_CONS_RELEASE,
+	// Hold the next letter of the alphabet, a-z
+	APP_KEYMAP_ACTION_LETTER_CYCLE,
+	// Play the macro given as usage
+	APP_KEYMAP_ACTION_MACRO,
+	APP_KEYMAP_ACTION_COUNT
+};
+
+// Repeat the consumer usage for as long as the button is held
+#define APP_KEYMAP_CONS_FLAG_REPEAT	BIT(0)
+
+struct app_keymap_action {
+	uint8_t type;
+	uint8_t modifiers;
+	uint16_t usage;
+};
+
+// Entry as written over the configuration service, usage is little endian
+struct app_keymap_entry {
+	uint8_t source;
+	uint8_t button;
+	uint8_t event;
+	uint8_t type;
+	uint8_t modifiers;
+	uint16_t usage;
+} __packed;
+
+// Load the default map. Stored changes are applied by settings_load().
+void app_keymap_init(void);
+
+struct app_keymap_action app_keymap_lookup(uint8_t source, uint8_t button, uint8_t event);
+
+bool app_keymap_entry_valid(const struct app_keymap_entry *entry);
+
+// Takes effect on the next button event. Call app_keymap_save() to persist it.
+int app_keymap_set(const struct app_keymap_entry *entry);
+
+void app_keymap_reset(void);
+
+// Store the map in settings shortly after, from the system work queue
+int app_keymap_save(void);
+
+// The map in lookup order, for reading it back
+void app_keymap_get(struct app_keymap_action *map, size_t count);
+
+#endif
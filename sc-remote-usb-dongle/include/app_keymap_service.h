@@ -0,0 +1,19 @@
+#ifndef __APP_KEYMAP_SERVICE_H
+#define __APP_KEYMAP_SERVICE_H
+
+#include <zephyr.h>
+#include <bluetooth/uuid.h>
+
+// Random 128-bit UUIDs generated from www.uuidgenerator.net/version4
+#define BT_UUID_SC_CONFIG_SERVICE_VAL BT_UUID_128_ENCODE(0x3f6c1a40, 0x8e2d, 0x4b9a, 0x9c71, 0x52e0d4a7b310)
+#define BT_UUID_SC_CONFIG_KEYMAP_VAL BT_UUID_128_ENCODE(0x3f6c1a41, 0x8e2d, 0x4b9a, 0x9c71, 0x52e0d4a7b310)
+#define BT_UUID_SC_CONFIG_MACRO_VAL BT_UUID_128_ENCODE(0x3f6c1a42, 0x8e2d, 0x4b9a, 0x9c71, 0x52e0d4a7b310)
+
+#define BT_UUID_SC_CONFIG_SERVICE BT_UUID_DECLARE_128(BT_UUID_SC_CONFIG_SERVICE_VAL)
+#define BT_UUID_SC_CONFIG_KEYMAP BT_UUID_DECLARE_128(BT_UUID_SC_CONFIG_KEYMAP_VAL)
+#define BT_UUID_SC_CONFIG_MACRO BT_UUID_DECLARE_128(BT_UUID_SC_CONFIG_MACRO_VAL)
+
+// Start advertising the configuration service. Needs Bluetooth to be enabled.
+int app_keymap_service_init(void);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __APP_LATENCY_H
+#define __APP_LATENCY_H
+
+#include <zephyr.h>
+
+// Latency is kept per key state source, see app_kbd_state.h
+#include "app_kbd_state.h"
+
+// Reports that are not caused by a timed event, such as repeats
+#define APP_LATENCY_SOURCE_NONE	0xFF
+
+enum app_latency_stage {
+	APP_LATENCY_STAGE_REMOTE,	// Button edge to bt_nus_send() on the remote
+	APP_LATENCY_STAGE_LINK,		// Radio delay above the best one observed
+	APP_LATENCY_STAGE_DECODE,	// Frame received to report queued
+	APP_LATENCY_STAGE_QUEUE,	// Report queued to hid_int_ep_write()
+	APP_LATENCY_STAGE_USB,		// hid_int_ep_write() to IN transfer complete
+	APP_LATENCY_STAGE_TOTAL,
+	APP_LATENCY_STAGE_COUNT
+};
+
+#if defined(CONFIG_SC_DONGLE_LATENCY_STATS)
+
+#include <latency_hist.h>
+
+// Per remote clock offset tracking. The two clocks are not synchronized, so
+// the link stage is measured relative to the fastest frame seen recently.
+struct app_latency_link {
+	uint32_t window_start;
+	uint16_t base_offset;
+	int16_t min_offset;
+	int16_t prev_min_offset;
+	bool valid;
+};
+
+// Timestamps carried along with a HID report
+struct app_latency_tag {
+	uint32_t rx;
+	uint32_t queued;
+	uint32_t submitted;
+	uint32_t upstream_us;
+	bool valid;
+};
+
+void app_latency_frame_rx(uint8_t source, struct app_latency_link *link,
+			  uint16_t remote_timestamp);
+void app_latency_local_rx(uint8_t source);
+void app_latency_event(uint8_t source, uint8_t age_ms);
+void app_latency_link_reset(struct app_latency_link *link);
+
+// Stamps the report with the event the source is currently handling
+void app_latency_tag_report(uint8_t source, struct app_latency_tag *tag);
+void app_latency_submitted(struct app_latency_tag *tag);
+void app_latency_completed(struct app_latency_tag *tag);
+
+// Copy of a histogram, consistent with the samples being added meanwhile
+void app_latency_hist_get(enum app_latency_stage stage, struct latency_hist *hist);
+const char *app_latency_stage_name(enum app_latency_stage stage);
+void app_latency_dump(void);
+void app_latency_reset(void);
+
+#else
+
+struct app_latency_link {};
+struct app_latency_tag {};
+
+static inline void app_latency_frame_rx(uint8_t source, struct app_latency_link *link,
+					uint16_t remote_timestamp) {}
+static inline void app_latency_local_rx(uint8_t source) {}
+static inline void app_latency_event(uint8_t source, uint8_t age_ms) {}
+static inline void app_latency_link_reset(struct app_latency_link *link) {}
+
+static inline void app_latency_tag_report(uint8_t source, struct app_latency_tag *tag) {}
+static inline void app_latency_submitted(struct app_latency_tag *tag) {}
+static inline void app_latency_completed(struct app_latency_tag *tag) {}
+
+static inline void app_latency_dump(void) {}
+static inline void app_latency_reset(void) {}
+
+#endif
+
+#endif
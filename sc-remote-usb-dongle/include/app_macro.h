@@ -0,0 +1,20 @@
+#ifndef __APP_MACRO_H
+#define __APP_MACRO_H
+
+#include <zephyr.h>
+
+/*
+ * A macro is a sequence of steps. Printable ASCII characters, '\n', '\t' and
+ * '\b' are typed on a US layout. APP_MACRO_OP_KEY is followed by a modifier
+ * byte and a usage, and taps that key combination.
+ */
+#define APP_MACRO_OP_KEY	0x01
+
+// Queue a macro for playback, macros are played one at a time in order
+int app_macro_play(uint8_t index);
+
+// Write part of a macro. Writing at offset 0 starts the macro over. The macro
+// is stored in settings shortly after, from the system work queue.
+int app_macro_write(uint8_t index, uint16_t offset, const uint8_t *data, uint16_t len);
+
+#endif
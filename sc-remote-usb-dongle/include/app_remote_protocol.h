@@ -0,0 +1,55 @@
+#ifndef __APP_REMOTE_PROTOCOL_H
+#define __APP_REMOTE_PROTOCOL_H
+
+#include <zephyr.h>
+
+#include <sc_protocol.h>
+
+#include "app_latency.h"
+
+struct app_remote_proto_rx;
+
+typedef void (*app_remote_proto_event_t)(struct app_remote_proto_rx *rx,
+					 uint8_t button, bool pressed,
+					 uint8_t age_ms);
+
+struct app_remote_proto_stats {
+	uint32_t frames;
+	uint32_t events;
+	uint32_t lost_frames;
+	uint32_t resyncs;
+	uint32_t malformed;
+};
+
+// Receive state for one remote. Only touched from the BLE RX context.
+struct app_remote_proto_rx {
+	app_remote_proto_event_t on_event;
+	// Key state and latency source of the remote, see app_kbd_state.h
+	uint8_t source;
+	uint16_t state;
+	uint8_t next_seq;
+	bool synced;
+	struct app_remote_proto_stats stats;
+	struct app_latency_link latency;
+	// Last counters frame from the remote, read from other threads
+	// through app_remote_proto_diag_get()
+	struct k_spinlock diag_lock;
+	uint8_t diag[SC_PROTO_STATS_MAX_SIZE];
+	uint8_t diag_len;
+	uint32_t diag_time;
+};
+
+int app_remote_proto_decode(struct app_remote_proto_rx *rx,
+			    const uint8_t *data, uint16_t length);
+
+// Release every button still held by the remote, and forget the sequence number
+// and its counters
+void app_remote_proto_reset(struct app_remote_proto_rx *rx);
+
+// Copy of the diagnostics records the remote sent last, see diag_service.h,
+// into buf of SC_PROTO_STATS_MAX_SIZE bytes. Returns their length, 0 if none
+// came since it connected.
+uint8_t app_remote_proto_diag_get(struct app_remote_proto_rx *rx, uint8_t *buf,
+				  uint32_t *age_ms);
+
+#endif
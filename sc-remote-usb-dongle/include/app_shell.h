@@ -0,0 +1,19 @@
+#ifndef __APP_SHELL_H
+#define __APP_SHELL_H
+
+#include <zephyr.h>
+
+#include "app_remote_protocol.h"
+
+#if defined(CONFIG_SC_DONGLE_SHELL)
+
+// Give the sc shell commands access to the decoders of the remote slots
+void app_shell_init(struct app_remote_proto_rx *remote_rx, uint8_t count);
+
+#else
+
+static inline void app_shell_init(struct app_remote_proto_rx *remote_rx, uint8_t count) {}
+
+#endif
+
+#endif
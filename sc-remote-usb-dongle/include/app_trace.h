@@ -0,0 +1,62 @@
+#ifndef __APP_TRACE_H
+#define __APP_TRACE_H
+
+#include <zephyr.h>
+
+// Record types of the binary event trace, see scripts/sc_trace.py
+enum app_trace_type {
+	// Sent when tracing starts. arg16: record size, cycles: cycle counter
+	// frequency in Hz
+	APP_TRACE_START,
+	// A NUS frame arrived. arg8: remote, arg16: length
+	APP_TRACE_FRAME_RX,
+	// A decoded remote button edge. arg8: remote,
+	// arg16: button | pressed << 7 | age_ms << 8
+	APP_TRACE_REMOTE_EVENT,
+	// A dongle button edge. arg16: button | pressed << 7
+	APP_TRACE_LOCAL_EVENT,
+	// A HID report was written straight from the caller. arg8: report ID
+	APP_TRACE_REPORT_DIRECT,
+	// A HID report was queued. arg8: report ID, arg16: queue depth
+	APP_TRACE_REPORT_QUEUED,
+	// A HID report was handed to the IN endpoint. arg8: report ID
+	APP_TRACE_REPORT_SUBMITTED,
+	// The host read an IN endpoint. arg8: 0 keyboard, 1 consumer control
+	APP_TRACE_REPORT_DONE,
+	// A HID report was dropped. arg8: report ID
+	APP_TRACE_REPORT_DROPPED,
+	// A remote disconnected. arg8: remote
+	APP_TRACE_DISCONNECTED,
+	APP_TRACE_TYPE_COUNT
+};
+
+// One trace record as sent to the host, little endian
+struct app_trace_record {
+	uint8_t type;
+	uint8_t arg8;
+	uint16_t arg16;
+	uint32_t cycles;
+} __packed;
+
+struct app_trace_stats {
+	uint32_t records;
+	uint32_t dropped;
+	bool enabled;
+};
+
+#if defined(CONFIG_SC_DONGLE_TRACE)
+
+// Safe to call from any context. Does nothing while tracing is off.
+void app_trace_event(enum app_trace_type type, uint8_t arg8, uint16_t arg16);
+
+int app_trace_enable(bool enable);
+
+void app_trace_stats_get(struct app_trace_stats *stats);
+
+#else
+
+static inline void app_trace_event(enum app_trace_type type, uint8_t arg8, uint16_t arg16) {}
+
+#endif
+
+#endif
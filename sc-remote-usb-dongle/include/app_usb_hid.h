@@ -19,10 +19,47 @@ enum {KEY_A=0x4, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J,
 		KEY_PRINTSCREEN=0x46, KEY_SCROLL_LOCK, KEY_PAUSE, KEY_INSERT, KEY_HOME, KEY_PAGE_UP, KEY_DEL_FORWARD, KEY_END, KEY_PAGE_DOWN, KEY_ARROW_RIGHT, KEY_ARROW_LEFT, KEY_ARROW_DOWN, KEY_ARROW_UP,
 		KEY_KPAD_NUM_LOCK=0x53, KEY_KPAD_DIVIDE, KEY_KPAD_MULTIPLY, KEY_KPAD_MINUS, KEY_KPAD_PLUS, KEY_KPAD_ENTER, KEY_KPAD_1, KEY_KPAD_2, KEY_KPAD_3, KEY_KPAD_4, KEY_KPAD_5, KEY_KPAD_6, KEY_KPAD_7, KEY_KPAD_8, KEY_KPAD_9, KEY_KPAD_0, KEY_KPAD_DOT};
 
+struct app_usb_hid_stats {
+	// Written straight from the caller, the endpoint was idle
+	uint32_t direct;
+	// Waited for the endpoint in the TX thread
+	uint32_t queued;
+	uint32_t coalesced;
+	uint32_t dropped;
+	uint32_t ep_timeouts;
+	uint32_t write_errors;
+	// Reports that found the IN endpoint busy, and the deepest the queue got
+	uint32_t ep_busy;
+	uint32_t queue_hwm;
+	// Reports not yet handed to the endpoint right now
+	uint32_t pending;
+};
+
 int app_usb_hid_init(void);
 
-int app_usb_hid_send_kbd_packet(uint8_t key1, uint8_t flags);
+// Keyboard usages 0x00 - 0xFF, one bit each
+#define APP_USB_HID_KEY_BITMAP_WORDS 8
+
+// The source is the one whose event caused the report, for the latency
+// statistics, or APP_LATENCY_SOURCE_NONE
+int app_usb_hid_send_kbd_state(uint8_t source, uint8_t flags, const uint32_t *key_bitmap);
+
+// Consumer control usages held right now, at most SC_HID_CONS_CTRL_SLOTS
+int app_usb_hid_send_cons_ctrl_state(uint8_t source, const uint16_t *usages, uint8_t count);
+
+/*
+ * Called from the system work queue when the idle period the host set with
+ * HID SET_IDLE runs out for a report, and nothing newer is on its way. The
+ * handler sends the current state of that report again, so a held key keeps
+ * being reported at the host's rate while the remote only sends edges.
+ */
+typedef void (*app_usb_hid_idle_handler_t)(uint8_t report_id);
+
+void app_usb_hid_idle_handler_set(app_usb_hid_idle_handler_t handler);
+
+// Wait until every queued report has been read by the host
+int app_usb_hid_wait_idle(int32_t timeout_ms);
 
-int app_usb_hid_send_cons_ctrl_packet(uint8_t cons_ctrl_bitfield);
+void app_usb_hid_stats_get(struct app_usb_hid_stats *stats);
 
 #endif
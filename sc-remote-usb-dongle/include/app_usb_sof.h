@@ -0,0 +1,33 @@
+#ifndef __APP_USB_SOF_H
+#define __APP_USB_SOF_H
+
+#include <zephyr.h>
+
+#if defined(CONFIG_SC_DONGLE_HID_SOF_STATS)
+
+// Called from the USB status callback on every start of frame
+void app_usb_sof_event(void);
+
+// A report was handed to the IN endpoint
+void app_usb_sof_submitted(void);
+
+// The host has read the report
+void app_usb_sof_completed(void);
+
+// Sleep until just before the host is expected to poll the IN endpoint.
+// Returns right away until the poll position has been learned.
+void app_usb_sof_align(void);
+
+void app_usb_sof_dump(void);
+
+#else
+
+static inline void app_usb_sof_event(void) {}
+static inline void app_usb_sof_submitted(void) {}
+static inline void app_usb_sof_completed(void) {}
+static inline void app_usb_sof_align(void) {}
+static inline void app_usb_sof_dump(void) {}
+
+#endif
+
+#endif
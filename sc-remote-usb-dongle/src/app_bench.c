@@ -0,0 +1,203 @@
+#include "app_bench.h"
+#include "app_remote_protocol.h"
+#include "app_usb_hid.h"
+
+#include <sys/byteorder.h>
+#include <timing/timing.h>
+
+#include <sc_protocol.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_bench, CONFIG_SC_LOG_LEVEL);
+
+#define BENCH_SLOT		(CONFIG_SC_DONGLE_MAX_REMOTES - 1)
+#define BENCH_DECODE_EVENTS	8
+#define BENCH_BUTTON		3
+#define HOST_TIMEOUT_MS		100
+
+static K_SEM_DEFINE(m_bench_start, 0, 1);
+static app_ble_nus_c_config_t m_handlers;
+
+static uint32_t m_decoded_events;
+
+static void count_event(struct app_remote_proto_rx *rx, uint8_t button,
+			bool pressed, uint8_t age_ms)
+{
+	m_decoded_events++;
+}
+
+// Frame with count events toggling one button, ending in the given state
+static uint16_t frame_build(uint8_t *frame, uint8_t seq, uint16_t count, bool pressed)
+{
+	struct sc_proto_hdr *hdr = (struct sc_proto_hdr *)frame;
+	struct sc_proto_evt *evt = (struct sc_proto_evt *)(frame + SC_PROTO_HDR_SIZE);
+
+	for (uint16_t i = 0; i < count; i++) {
+		// The last event leaves the button as requested
+		bool evt_pressed = ((count - i) % 2) ? pressed : !pressed;
+
+		evt[i].button = BENCH_BUTTON | (evt_pressed ? SC_PROTO_EVT_PRESSED : 0);
+		evt[i].age = 0;
+	}
+
+	hdr->version = SC_PROTO_VERSION_BYTE;
+	hdr->seq = seq;
+	hdr->timestamp = sys_cpu_to_le16((uint16_t)k_uptime_get_32());
+	hdr->state = sys_cpu_to_le16(pressed ? BIT(BENCH_BUTTON) : 0);
+
+	return SC_PROTO_FRAME_SIZE(count);
+}
+
+static void log_result(const char *name, uint32_t frames, uint32_t events, uint64_t cycles)
+{
+	uint64_t ns = timing_cycles_to_ns(cycles);
+
+	if (!events) {
+		LOG_INF("%-8s no events", name);
+		return;
+	}
+
+	LOG_INF("%-8s %u frames, %u events: %u cycles/event, %u ns/event, %u events/s",
+		name, frames, events, (uint32_t)(cycles / events), (uint32_t)(ns / events),
+		ns ? (uint32_t)((uint64_t)events * NSEC_PER_SEC / ns) : 0);
+}
+
+// Decoder only, the events go nowhere
+static void bench_decode(void)
+{
+	static uint8_t frame[SC_PROTO_FRAME_SIZE(BENCH_DECODE_EVENTS)];
+	struct app_remote_proto_rx rx = {.on_event = count_event};
+	timing_t start, end;
+	uint16_t len;
+
+	m_decoded_events = 0;
+	len = frame_build(frame, 0, BENCH_DECODE_EVENTS, false);
+
+	start = timing_counter_get();
+	for (uint32_t i = 0; i < CONFIG_SC_DONGLE_BENCH_ITERATIONS; i++) {
+		((struct sc_proto_hdr *)frame)->seq = i;
+		app_remote_proto_decode(&rx, frame, len);
+	}
+	end = timing_counter_get();
+
+	log_result("decode", CONFIG_SC_DONGLE_BENCH_ITERATIONS, m_decoded_events,
+		   timing_cycles_get(&start, &end));
+}
+
+#if defined(CONFIG_THREAD_RUNTIME_STATS) && defined(CONFIG_THREAD_MONITOR)
+static void add_thread_cycles(const struct k_thread *thread, void *user_data)
+{
+	k_thread_runtime_stats_t rt;
+
+	// The caller's cost is timed on its own, idle time is not a cost
+	if ((thread == k_current_get()) ||
+	    (k_thread_priority_get((k_tid_t)thread) == K_IDLE_PRIO)) {
+		return;
+	}
+
+	if (!k_thread_runtime_stats_get((k_tid_t)thread, &rt)) {
+		*(uint64_t *)user_data += rt.execution_cycles;
+	}
+}
+
+// Cycles run by every other thread so far, such as the log and USB threads
+static uint64_t other_thread_cycles(void)
+{
+	uint64_t cycles = 0;
+
+	k_thread_foreach(add_thread_cycles, &cycles);
+	return cycles;
+}
+#else
+static uint64_t other_thread_cycles(void)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Decode, key map lookup, key state merge and report enqueue, one event per
+ * frame. The host reading the report is left out of the measurement.
+ *
+ * Deferred work, such as formatting the logs of the path, runs on other
+ * threads. With thread runtime stats, the cycles those threads run meanwhile
+ * are logged as well, so that the total cost of an event can be compared
+ * between log configurations.
+ */
+static void bench_pipeline(void)
+{
+	static uint8_t frame[SC_PROTO_FRAME_SIZE(1)];
+	uint64_t cycles = 0;
+	uint64_t others;
+	timing_t start, end;
+	uint32_t frames = 0;
+	uint16_t len;
+
+	// The frames would mix with the keys and stats of a real remote
+	if (app_ble_nus_c_connected(BENCH_SLOT)) {
+		LOG_WRN("Remote %u connected, pipeline benchmark skipped", BENCH_SLOT);
+		return;
+	}
+
+	others = other_thread_cycles();
+
+	for (uint32_t i = 0; i < CONFIG_SC_DONGLE_BENCH_ITERATIONS; i++) {
+		if (app_ble_nus_c_connected(BENCH_SLOT)) {
+			// Leave the slot to the remote, its first frame resyncs the keys
+			LOG_WRN("Remote %u connected, pipeline benchmark stopped", BENCH_SLOT);
+			log_result("pipeline", frames, frames, cycles);
+			return;
+		}
+
+		len = frame_build(frame, i, 1, !(i % 2));
+
+		if (app_usb_hid_wait_idle(HOST_TIMEOUT_MS)) {
+			LOG_WRN("Host not reading reports, pipeline benchmark stopped");
+			break;
+		}
+
+		start = timing_counter_get();
+		m_handlers.on_data_received(BENCH_SLOT, frame, len);
+		end = timing_counter_get();
+		cycles += timing_cycles_get(&start, &end);
+		frames++;
+	}
+
+	// Let the log thread catch up with what the path queued
+	k_sleep(K_MSEC(HOST_TIMEOUT_MS));
+	others = other_thread_cycles() - others;
+
+	if (m_handlers.on_disconnected) {
+		m_handlers.on_disconnected(BENCH_SLOT);
+	}
+
+	log_result("pipeline", frames, frames, cycles);
+	if (IS_ENABLED(CONFIG_THREAD_RUNTIME_STATS) && IS_ENABLED(CONFIG_THREAD_MONITOR)) {
+		log_result("deferred", frames, frames, others);
+	}
+}
+
+static void bench_thread_fn(void)
+{
+	k_sem_take(&m_bench_start, K_FOREVER);
+
+	// Leave time for the host to enumerate the device
+	k_sleep(K_SECONDS(CONFIG_SC_DONGLE_BENCH_DELAY));
+
+	timing_init();
+	timing_start();
+
+	bench_decode();
+	bench_pipeline();
+
+	timing_stop();
+}
+
+K_THREAD_DEFINE(m_bench_thread, 1024, bench_thread_fn, NULL, NULL, NULL, 7, 0, 0);
+
+void app_bench_start(const app_ble_nus_c_config_t *handlers)
+{
+	m_handlers = *handlers;
+	k_sem_give(&m_bench_start);
+}
@@ -10,9 +10,9 @@
 
 #include "app_ble_nus_c_handler.h"
 #include <errno.h>
+#include <string.h>
 #include <zephyr.h>
 #include <sys/byteorder.h>
-#include <sys/printk.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -27,10 +27,16 @@
 
 #include <settings/settings.h>
 
+#include <conn_params.h>
+#include <link_setup.h>
+#include <sc_log.h>
+
+#include "app_gatt_cache.h"
+
 #include <logging/log.h>
 
 #define LOG_MODULE_NAME app_ble_nus_c_handler
-LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, CONFIG_SC_LOG_LEVEL);
 
 // Random 128-bit UUID generated from www.uuidgenerator.net/version4
 #define BT_UUID_SC_REMOTE_SERVICE BT_UUID_DECLARE_128(BT_UUID_128_ENCODE(0x988f9c8d, 0x2b03, 0x489f, 0xa102, 0x4d83463b90f3))
@@ -45,10 +51,122 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
 #define UART_RX_TIMEOUT 50
 
-static struct bt_conn *default_conn;
-static struct bt_nus_client nus_client;
+// Per connection state, one entry per remote
+struct remote {
+	struct bt_conn *conn;
+	struct bt_nus_client nus_client;
+	// Uptime at connection, to measure how long it takes before input can arrive
+	uint32_t connect_time;
+	struct bt_gatt_exchange_params exchange_params;
+	// Database Hash read, either to verify cached handles or to store fresh ones
+	struct bt_gatt_read_params db_hash_read_params;
+	bool db_hash_verify;
+	// NUS handles taken from the cache rather than discovered
+	bool handles_cached;
+	// The stack keeps the subscription of a bonded peer across disconnections,
+	// so the NUS client stays tied to the peer the slot last served
+	bt_addr_le_t peer;
+	bool subscribed;
+};
+
+static struct remote m_remotes[CONFIG_SC_DONGLE_MAX_REMOTES];
+// Guards the conn of every slot against app_ble_nus_c_conn_get() from other threads
+static struct k_spinlock m_conn_lock;
+
+#if defined(CONFIG_SC_CONN_PARAMS)
+// Connect straight away with the parameters the policy would ask for anyway
+#define CONN_PARAM_INITIAL BT_LE_CONN_PARAM(CONFIG_SC_CONN_PARAMS_ACTIVE_INTERVAL, \
+					    CONFIG_SC_CONN_PARAMS_ACTIVE_INTERVAL, \
+					    CONFIG_SC_CONN_PARAMS_ACTIVE_LATENCY, \
+					    CONFIG_SC_CONN_PARAMS_SUPERVISION_TIMEOUT)
+#else
+#define CONN_PARAM_INITIAL BT_LE_CONN_PARAM_DEFAULT
+#endif
+
+enum reconnect_state {
+	RECONNECT_IDLE,
+	RECONNECT_BURST,
+	RECONNECT_BURST_STOPPING,
+	RECONNECT_SCAN,
+};
+
+static enum reconnect_state m_reconnect_state;
+static uint32_t m_reconnect_start;
+static uint8_t m_bond_count;
+// Bonds added or removed since the accept list was built
+static bool m_accept_list_dirty = true;
+static atomic_t m_connect_count;
 
 static app_ble_nus_c_data_received_t m_data_received_callback;
+static app_ble_nus_c_disconnected_t m_disconnected_callback;
+
+static inline uint8_t remote_index(const struct remote *remote)
+{
+	return remote - m_remotes;
+}
+
+static struct remote *remote_find(const struct bt_conn *conn)
+{
+	for (int i = 0; i < ARRAY_SIZE(m_remotes); i++) {
+		if (m_remotes[i].conn == conn) {
+			return &m_remotes[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Slot for a new connection to the peer. The slot that served it last comes
+ * first, it may still hold the peer's subscription. A slot whose NUS client
+ * is still subscribed for another peer would deliver that peer's
+ * notifications, so it is never handed out.
+ */
+static struct remote *remote_alloc(const bt_addr_le_t *addr)
+{
+	struct remote *fallback = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(m_remotes); i++) {
+		struct remote *remote = &m_remotes[i];
+
+		if (remote->conn) {
+			continue;
+		}
+		if (!bt_addr_le_cmp(&remote->peer, addr)) {
+			return remote;
+		}
+		if (!remote->subscribed && !fallback) {
+			fallback = remote;
+		}
+	}
+	return fallback;
+}
+
+// Put a connection in the slot, or NULL to free it. The slot's reference is
+// dropped outside the lock.
+static void remote_conn_set(struct remote *remote, struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_conn_lock);
+	struct bt_conn *old = remote->conn;
+
+	remote->conn = conn ? bt_conn_ref(conn) : NULL;
+	k_spin_unlock(&m_conn_lock, key);
+
+	if (old) {
+		bt_conn_unref(old);
+	}
+}
+
+static uint8_t remote_free_count(void)
+{
+	uint8_t count = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(m_remotes); i++) {
+		if (!m_remotes[i].conn) {
+			count++;
+		}
+	}
+	return count;
+}
 
 static void ble_data_sent(struct bt_nus_client *nus, uint8_t err,
 					const uint8_t *const data, uint16_t len)
@@ -59,22 +177,188 @@ static void ble_data_sent(struct bt_nus_client *nus, uint8_t err,
 static uint8_t ble_data_received(struct bt_nus_client *nus,
 						const uint8_t *data, uint16_t len)
 {
+	struct remote *remote = CONTAINER_OF(nus, struct remote, nus_client);
+
+	if (!remote->conn) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	if (IS_ENABLED(CONFIG_SC_CONN_PARAMS)) {
+		conn_params_activity(nus->conn);
+	}
+
 	if(m_data_received_callback) {
-		m_data_received_callback(data, len);
+		m_data_received_callback(remote_index(remote), data, len);
 	}
 	return BT_GATT_ITER_CONTINUE;
 }
 
+static void ble_unsubscribed(struct bt_nus_client *nus)
+{
+	struct remote *remote = CONTAINER_OF(nus, struct remote, nus_client);
+
+	remote->subscribed = false;
+}
+
+static void nus_ready(struct remote *remote)
+{
+	LOG_INF("Remote %u: NUS subscribed %u ms after connection (%s handles)",
+		remote_index(remote), k_uptime_get_32() - remote->connect_time,
+		remote->handles_cached ? "cached" : "discovered");
+}
+
+// Response to the CCC write of bt_nus_subscribe_receive()
+static void nus_subscribe_cb(struct bt_conn *conn, uint8_t err,
+			     struct bt_gatt_subscribe_params *params)
+{
+	struct remote *remote = CONTAINER_OF(params, struct remote, nus_client.tx_notif_params);
+
+	if (!params->value || (remote->conn != conn)) {
+		return;
+	}
+
+	if (!err) {
+		nus_ready(remote);
+		return;
+	}
+
+	LOG_WRN("Remote %u: NUS subscription rejected (ATT err 0x%02x)", remote_index(remote), err);
+
+	// Cached handles pointing at the wrong attribute. Discover again on the next connection.
+	if (IS_ENABLED(CONFIG_SC_DONGLE_GATT_CACHE) && remote->handles_cached) {
+		app_gatt_cache_invalidate(bt_conn_get_dst(conn));
+		bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	}
+}
+
+/*
+ * Subscribe to the remote's NUS TX characteristic. -EALREADY is only taken as
+ * the bonded subscription the stack restored, when the slot last served this
+ * same peer; connected() never puts a peer in a slot subscribed for another.
+ */
+static int nus_subscribe(struct remote *remote)
+{
+	int err = bt_nus_subscribe_receive(&remote->nus_client);
+
+	if (!err) {
+		// Reported by nus_subscribe_cb() once the CCC write completes
+		remote->subscribed = true;
+		return 0;
+	}
+
+	if ((err == -EALREADY) && remote->subscribed &&
+	    !bt_addr_le_cmp(&remote->peer, bt_conn_get_dst(remote->conn))) {
+		nus_ready(remote);
+		return 0;
+	}
+
+	return err;
+}
+
+static uint8_t db_hash_read_cb(struct bt_conn *conn, uint8_t err,
+			       struct bt_gatt_read_params *params,
+			       const void *data, uint16_t length)
+{
+	struct remote *remote = CONTAINER_OF(params, struct remote, db_hash_read_params);
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	const uint8_t *db_hash = NULL;
+
+	if (!err && data && (length == APP_GATT_CACHE_DB_HASH_LEN)) {
+		db_hash = data;
+	}
+
+	if (remote->db_hash_verify) {
+		const struct app_gatt_cache_entry *entry = app_gatt_cache_find(addr);
+
+		if (entry && db_hash &&
+		    memcmp(entry->db_hash, db_hash, APP_GATT_CACHE_DB_HASH_LEN)) {
+			// The remote's database changed, so the cached handles are stale.
+			// Start over with a fresh discovery on the next connection.
+			LOG_WRN("Remote database changed, dropping cached handles");
+			app_gatt_cache_invalidate(addr);
+			bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		}
+	} else {
+		app_gatt_cache_store(addr, &remote->nus_client.handles, db_hash);
+	}
+
+	return BT_GATT_ITER_STOP;
+}
+
+static void db_hash_read(struct remote *remote, bool verify)
+{
+	struct bt_gatt_read_params *params = &remote->db_hash_read_params;
+	int err;
+
+	remote->db_hash_verify = verify;
+	params->func = db_hash_read_cb;
+	params->handle_count = 0;
+	params->by_uuid.uuid = BT_UUID_GATT_DB_HASH;
+	params->by_uuid.start_handle = BT_ATT_FIRST_ATTTRIBUTE_HANDLE;
+	params->by_uuid.end_handle = BT_ATT_LAST_ATTTRIBUTE_HANDLE;
+
+	err = bt_gatt_read(remote->conn, params);
+	if (err) {
+		LOG_WRN("Database Hash read failed (err %d)", err);
+		if (!verify) {
+			app_gatt_cache_store(bt_conn_get_dst(remote->conn),
+					     &remote->nus_client.handles, NULL);
+		}
+	}
+}
+
+// Skip discovery if the handles of this bonded remote are already known
+static bool nus_cache_restore(struct remote *remote)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(remote->conn);
+	const struct app_gatt_cache_entry *entry = app_gatt_cache_find(addr);
+	int err;
+
+	if (!entry) {
+		return false;
+	}
+
+	remote->nus_client.conn = remote->conn;
+	remote->nus_client.handles = entry->handles;
+	remote->handles_cached = true;
+
+	err = nus_subscribe(remote);
+	if (err) {
+		LOG_WRN("Cached NUS handles rejected (err %d)", err);
+		app_gatt_cache_invalidate(addr);
+		remote->handles_cached = false;
+		return false;
+	}
+
+	if (entry->db_hash_valid) {
+		db_hash_read(remote, true);
+	}
+	return true;
+}
+
 static void discovery_complete(struct bt_gatt_dm *dm,
 			       void *context)
 {
-	struct bt_nus_client *nus = context;
+	struct remote *remote = context;
+	struct bt_nus_client *nus = &remote->nus_client;
+	int err;
+
 	LOG_INF("Service discovery completed");
 
 	bt_gatt_dm_data_print(dm);
 
 	bt_nus_handles_assign(dm, nus);
-	bt_nus_subscribe_receive(nus);
+	remote->handles_cached = false;
+	err = nus_subscribe(remote);
+	if (err) {
+		LOG_ERR("Remote %u: NUS subscription failed (err %d)", remote_index(remote), err);
+		bt_conn_disconnect(nus->conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	}
+
+	if (IS_ENABLED(CONFIG_SC_DONGLE_GATT_CACHE) &&
+	    (bt_conn_get_security(nus->conn) >= BT_SECURITY_L2)) {
+		db_hash_read(remote, false);
+	}
 
 	bt_gatt_dm_data_release(dm);
 }
@@ -100,16 +384,21 @@ struct bt_gatt_dm_cb discovery_cb = {
 
 static void gatt_discover(struct bt_conn *conn)
 {
+	struct remote *remote = remote_find(conn);
 	int err;
 
-	if (conn != default_conn) {
+	if (!remote) {
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_SC_DONGLE_GATT_CACHE) && nus_cache_restore(remote)) {
 		return;
 	}
 
 	err = bt_gatt_dm_start(conn,
 			       BT_UUID_NUS_SERVICE,
 			       &discovery_cb,
-			       &nus_client);
+			       remote);
 	if (err) {
 		LOG_ERR("could not start the discovery procedure, error "
 			"code: %d", err);
@@ -119,43 +408,233 @@ static void gatt_discover(struct bt_conn *conn)
 static void exchange_func(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
 {
 	if (!err) {
-		LOG_INF("MTU exchange done");
+		LOG_INF("MTU exchange done, MTU %u", bt_gatt_get_mtu(conn));
 	} else {
 		LOG_WRN("MTU exchange failed (err %" PRIu8 ")", err);
 	}
 }
 
+static void scan_start(bool backoff)
+{
+	int err;
+
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+	struct bt_le_scan_param scan_param = {
+		.type = BT_LE_SCAN_TYPE_ACTIVE,
+		.options = BT_LE_SCAN_OPT_FILTER_DUPLICATE,
+		.interval = backoff ? CONFIG_SC_DONGLE_SCAN_BACKOFF_INTERVAL : BT_GAP_SCAN_FAST_INTERVAL,
+		.window = backoff ? CONFIG_SC_DONGLE_SCAN_BACKOFF_WINDOW : BT_GAP_SCAN_FAST_WINDOW,
+	};
+
+	bt_scan_params_set(&scan_param);
+#endif
+
+	m_reconnect_state = RECONNECT_SCAN;
+
+	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+	if (err) {
+		LOG_ERR("Scanning failed to start (err %d)", err);
+	}
+}
+
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+static void burst_timeout_handler(struct k_work *work)
+{
+	int err;
+
+	if (m_reconnect_state != RECONNECT_BURST) {
+		return;
+	}
+
+	m_reconnect_state = RECONNECT_BURST_STOPPING;
+
+	// The cancelled connection is reported to connected(), which carries on scanning
+	err = bt_conn_create_auto_stop();
+	if (err) {
+		LOG_WRN("Failed to stop auto connect (err %d)", err);
+		scan_start(true);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(m_burst_work, burst_timeout_handler);
+
+static void accept_list_add_bond(const struct bt_bond_info *info, void *user_data)
+{
+	int err = bt_le_filter_accept_list_add(&info->addr);
+
+	if (err) {
+		LOG_WRN("Failed to add bond to the accept list (err %d)", err);
+		return;
+	}
+
+	m_bond_count++;
+}
+
+// Only while the controller is not connecting from the list
+static void accept_list_rebuild(void)
+{
+	int err = bt_le_filter_accept_list_clear();
+
+	m_bond_count = 0;
+	if (err) {
+		LOG_WRN("Failed to clear the accept list (err %d)", err);
+		return;
+	}
+
+	bt_foreach_bond(BT_ID_DEFAULT, accept_list_add_bond, NULL);
+	m_accept_list_dirty = false;
+}
+
+/*
+ * A remote usually bonds while auto connect is running for the other slots,
+ * when the list can't be changed. End the burst early, connected() starts
+ * over with the list rebuilt.
+ */
+static void accept_list_changed(void)
+{
+	m_accept_list_dirty = true;
+
+	if (m_reconnect_state == RECONNECT_BURST) {
+		k_work_reschedule(&m_burst_work, K_NO_WAIT);
+	}
+}
+#endif
+
+/*
+ * Look for remotes while a remote slot is free. Bonded remotes are connected
+ * to by the controller as soon as one of their advertising packets is heard,
+ * with a high duty cycle for a bounded time. After that, or without bonds,
+ * fall back to scanning for the remote service UUID.
+ */
+static void reconnect_start(void)
+{
+	if (!remote_free_count()) {
+		LOG_INF("All %u remote slots in use, not scanning", ARRAY_SIZE(m_remotes));
+		m_reconnect_state = RECONNECT_IDLE;
+		return;
+	}
+
+	m_reconnect_start = k_uptime_get_32();
+
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+	if (m_accept_list_dirty) {
+		accept_list_rebuild();
+	}
+
+	if (m_bond_count) {
+		struct bt_conn_le_create_param create_param =
+			BT_CONN_LE_CREATE_PARAM_INIT(BT_CONN_LE_OPT_NONE,
+						     CONFIG_SC_DONGLE_RECONNECT_BURST_INTERVAL,
+						     CONFIG_SC_DONGLE_RECONNECT_BURST_WINDOW);
+		int err;
+
+		err = bt_conn_le_create_auto(&create_param, CONN_PARAM_INITIAL);
+		if (!err) {
+			LOG_INF("Fast reconnect to %u bonded remote(s)", m_bond_count);
+			m_reconnect_state = RECONNECT_BURST;
+			k_work_schedule(&m_burst_work, K_MSEC(CONFIG_SC_DONGLE_RECONNECT_BURST_MS));
+			return;
+		}
+		LOG_WRN("Auto connect failed to start (err %d)", err);
+	}
+#endif
+
+	scan_start(false);
+}
+
+static bool conn_is_remote(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	// Configuration tools connect to the dongle, the dongle connects to remotes
+	return !bt_conn_get_info(conn, &info) && (info.role == BT_CONN_ROLE_CENTRAL);
+}
+
 static void connected(struct bt_conn *conn, uint8_t conn_err)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	struct remote *remote;
 	int err;
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	if (!conn_is_remote(conn)) {
+		return;
+	}
 
 	if (conn_err) {
-		LOG_INF("Failed to connect to %s (%d)", log_strdup(addr),
+		if (m_reconnect_state == RECONNECT_BURST_STOPPING) {
+			if (m_accept_list_dirty) {
+				LOG_INF("Bonds changed, restarting fast reconnect");
+				reconnect_start();
+				return;
+			}
+
+			LOG_INF("No bonded remote found, back off to scanning");
+			scan_start(true);
+			return;
+		}
+
+		LOG_INF("Failed to connect to " SC_ADDR_FMT " (%d)", SC_ADDR_ARGS(addr),
 			conn_err);
 
-		if (default_conn == conn) {
-			bt_conn_unref(default_conn);
-			default_conn = NULL;
+		remote = remote_find(conn);
+		if (remote) {
+			remote_conn_set(remote, NULL);
 
-			err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-			if (err) {
-				LOG_ERR("Scanning failed to start (err %d)",
-					err);
-			}
+			scan_start(false);
+		}
+
+		return;
+	}
+
+	// Connections made by the controller from the accept list bypass the scan module
+	remote = remote_find(conn);
+	if (!remote) {
+		remote = remote_alloc(addr);
+		if (!remote) {
+			LOG_WRN("No free remote slot for " SC_ADDR_FMT, SC_ADDR_ARGS(addr));
+			bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+			return;
+		}
+		remote_conn_set(remote, conn);
+	}
+
+	// The scan module picks a slot before the identity address is known. Move
+	// the connection if the peer turns out to have a slot of its own.
+	if (bt_addr_le_cmp(&remote->peer, addr)) {
+		struct remote *own = remote_alloc(addr);
+
+		if (own && (remote->subscribed || !bt_addr_le_cmp(&own->peer, addr))) {
+			k_spinlock_key_t key = k_spin_lock(&m_conn_lock);
+
+			own->conn = remote->conn;
+			remote->conn = NULL;
+			k_spin_unlock(&m_conn_lock, key);
+			remote = own;
 		}
+	}
 
+	if (remote->subscribed && bt_addr_le_cmp(&remote->peer, addr)) {
+		LOG_WRN("Remote %u still subscribed for another peer, dropping " SC_ADDR_FMT,
+			remote_index(remote), SC_ADDR_ARGS(addr));
+		bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
 		return;
 	}
+	bt_addr_le_copy(&remote->peer, addr);
+
+	remote->connect_time = k_uptime_get_32();
+	atomic_inc(&m_connect_count);
 
-	LOG_INF("Connected: %s", log_strdup(addr));
+	LOG_INF("Remote %u connected: " SC_ADDR_FMT ", %u ms after %s", remote_index(remote),
+		SC_ADDR_ARGS(addr), remote->connect_time - m_reconnect_start,
+		(m_reconnect_state == RECONNECT_SCAN) ? "scan start" : "fast reconnect start");
 
-	static struct bt_gatt_exchange_params exchange_params;
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+	k_work_cancel_delayable(&m_burst_work);
+#endif
+	m_reconnect_state = RECONNECT_IDLE;
 
-	exchange_params.func = exchange_func;
-	err = bt_gatt_exchange_mtu(conn, &exchange_params);
+	remote->exchange_params.func = exchange_func;
+	err = bt_gatt_exchange_mtu(conn, &remote->exchange_params);
 	if (err) {
 		LOG_WRN("MTU exchange failed (err %d)", err);
 	}
@@ -167,48 +646,49 @@ static void connected(struct bt_conn *conn, uint8_t conn_err)
 		gatt_discover(conn);
 	}
 
-	err = bt_scan_stop();
-	if ((!err) && (err != -EALREADY)) {
-		LOG_ERR("Stop LE scan failed (err %d)", err);
-	}
+	// Scanning and auto connect both stop when a connection is made, keep
+	// looking for more remotes while there is room for them
+	reconnect_start();
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-	int err;
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	struct remote *remote = remote_find(conn);
 
-	LOG_INF("Disconnected: %s (reason %u)", log_strdup(addr),
+	LOG_INF("Disconnected: " SC_ADDR_FMT " (reason %u)", SC_ADDR_ARGS(addr),
 		reason);
 
-	if (default_conn != conn) {
+	if (!remote) {
 		return;
 	}
 
-	bt_conn_unref(default_conn);
-	default_conn = NULL;
+	remote_conn_set(remote, NULL);
 
-	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-	if (err) {
-		LOG_ERR("Scanning failed to start (err %d)",
-			err);
+	if (m_disconnected_callback) {
+		m_disconnected_callback(remote_index(remote));
+	}
+
+	// A slow scan may already be running for the other slots. Restart so a
+	// bonded remote that just dropped gets the fast reconnect burst.
+	if (m_reconnect_state == RECONNECT_SCAN) {
+		bt_scan_stop();
+		reconnect_start();
+	} else if (m_reconnect_state == RECONNECT_IDLE) {
+		reconnect_start();
 	}
 }
 
 static void security_changed(struct bt_conn *conn, bt_security_t level,
 			     enum bt_security_err err)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
 	if (!err) {
-		LOG_INF("Security changed: %s level %u", log_strdup(addr),
+		LOG_INF("Security changed: " SC_ADDR_FMT " level %u", SC_ADDR_ARGS(addr),
 			level);
 	} else {
-		LOG_WRN("Security failed: %s level %u err %d", log_strdup(addr),
+		LOG_WRN("Security failed: " SC_ADDR_FMT " level %u err %d", SC_ADDR_ARGS(addr),
 			level, err);
 	}
 
@@ -225,12 +705,10 @@ static void scan_filter_match(struct bt_scan_device_info *device_info,
 			      struct bt_scan_filter_match *filter_match,
 			      bool connectable)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(device_info->recv_info->addr, addr, sizeof(addr));
+	const bt_addr_le_t *addr = device_info->recv_info->addr;
 
-	LOG_INF("Filters matched. Address: %s connectable: %d",
-		log_strdup(addr), connectable);
+	LOG_INF("Filters matched. Address: " SC_ADDR_FMT " connectable: %d",
+		SC_ADDR_ARGS(addr), connectable);
 }
 
 static void scan_connecting_error(struct bt_scan_device_info *device_info)
@@ -241,7 +719,12 @@ static void scan_connecting_error(struct bt_scan_device_info *device_info)
 static void scan_connecting(struct bt_scan_device_info *device_info,
 			    struct bt_conn *conn)
 {
-	default_conn = bt_conn_ref(conn);
+	struct remote *remote = remote_alloc(bt_conn_get_dst(conn));
+
+	// Only scanning while a slot is free, so there is usually one here
+	if (remote) {
+		remote_conn_set(remote, conn);
+	}
 }
 
 static int nus_client_init(void)
@@ -251,13 +734,18 @@ static int nus_client_init(void)
 		.cb = {
 			.received = ble_data_received,
 			.sent = ble_data_sent,
+			.unsubscribed = ble_unsubscribed,
 		}
 	};
 
-	err = bt_nus_client_init(&nus_client, &init);
-	if (err) {
-		LOG_ERR("NUS Client initialization failed (err %d)", err);
-		return err;
+	for (int i = 0; i < ARRAY_SIZE(m_remotes); i++) {
+		err = bt_nus_client_init(&m_remotes[i].nus_client, &init);
+		if (err) {
+			LOG_ERR("NUS Client initialization failed (err %d)", err);
+			return err;
+		}
+		// Left alone by the NUS client, reports whether the CCC write went through
+		m_remotes[i].nus_client.tx_notif_params.subscribe = nus_subscribe_cb;
 	}
 
 	LOG_INF("NUS Client module initialized");
@@ -272,6 +760,7 @@ static int scan_init(void)
 	int err;
 	struct bt_scan_init_param scan_init = {
 		.connect_if_match = 1,
+		.conn_param = CONN_PARAM_INITIAL,
 	};
 
 	bt_scan_init(&scan_init);
@@ -294,48 +783,124 @@ static int scan_init(void)
 }
 
 
-static void auth_cancel(struct bt_conn *conn)
+/*
+ * The dongle's only display is its log. Giving the passkey makes it a display
+ * only device, so a configuration tool with a keyboard pairs with passkey
+ * entry and gets an authenticated link. Remotes have no keyboard and still
+ * pair with Just Works.
+ */
+static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	LOG_INF("Passkey for " SC_ADDR_FMT ": %06u", SC_ADDR_ARGS(addr), passkey);
+}
+
+static void auth_cancel(struct bt_conn *conn)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	LOG_INF("Pairing cancelled: %s", log_strdup(addr));
+	LOG_INF("Pairing cancelled: " SC_ADDR_FMT, SC_ADDR_ARGS(addr));
 }
 
 
-static void pairing_complete(struct bt_conn *conn, bool bonded)
+/*
+ * A new pairing may come with a different database. The pairing response
+ * arrives before encryption is set up, so the cached handles are gone by the
+ * time security_changed() looks for them, and this connection already runs
+ * on discovered handles.
+ */
+static enum bt_security_err pairing_accept(struct bt_conn *conn,
+					   const struct bt_conn_pairing_feat *const feat)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	if (IS_ENABLED(CONFIG_SC_DONGLE_GATT_CACHE) && conn_is_remote(conn)) {
+		app_gatt_cache_invalidate(bt_conn_get_dst(conn));
+	}
+	return BT_SECURITY_ERR_SUCCESS;
+}
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+static void pairing_complete(struct bt_conn *conn, bool bonded)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	LOG_INF("Pairing completed: %s, bonded: %d", log_strdup(addr),
+	LOG_INF("Pairing completed: " SC_ADDR_FMT ", bonded: %d", SC_ADDR_ARGS(addr),
 		bonded);
+
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+	if (bonded) {
+		accept_list_changed();
+	}
+#endif
 }
 
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+static void bond_deleted(uint8_t id, const bt_addr_le_t *peer)
+{
+	accept_list_changed();
+}
+#endif
+
 
 static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	LOG_WRN("Pairing failed conn: %s, reason %d", log_strdup(addr),
+	LOG_WRN("Pairing failed conn: " SC_ADDR_FMT ", reason %d", SC_ADDR_ARGS(addr),
 		reason);
 }
 
 static struct bt_conn_auth_cb conn_auth_callbacks = {
+	.passkey_display = auth_passkey_display,
+	.pairing_accept = pairing_accept,
 	.cancel = auth_cancel,
 	.pairing_complete = pairing_complete,
-	.pairing_failed = pairing_failed
+	.pairing_failed = pairing_failed,
+#if defined(CONFIG_SC_DONGLE_FAST_RECONNECT)
+	.bond_deleted = bond_deleted,
+#endif
 };
 
+struct bt_conn *app_ble_nus_c_conn_get(uint8_t remote)
+{
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key;
+
+	if (remote >= ARRAY_SIZE(m_remotes)) {
+		return NULL;
+	}
+
+	key = k_spin_lock(&m_conn_lock);
+	if (m_remotes[remote].conn) {
+		conn = bt_conn_ref(m_remotes[remote].conn);
+	}
+	k_spin_unlock(&m_conn_lock, key);
+
+	return conn;
+}
+
+bool app_ble_nus_c_connected(uint8_t remote)
+{
+	struct bt_conn *conn = app_ble_nus_c_conn_get(remote);
+
+	if (!conn) {
+		return false;
+	}
+
+	bt_conn_unref(conn);
+	return true;
+}
+
+uint32_t app_ble_nus_c_connect_count(void)
+{
+	return atomic_get(&m_connect_count);
+}
+
 int app_ble_nus_c_init(app_ble_nus_c_config_t *config)
 {
 	int err;
 
 	m_data_received_callback = config->on_data_received;
+	m_disconnected_callback = config->on_disconnected;
 
 	err = bt_conn_auth_cb_register(&conn_auth_callbacks);
 	if (err) {
@@ -356,6 +921,14 @@ int app_ble_nus_c_init(app_ble_nus_c_config_t *config)
 
 	bt_conn_cb_register(&conn_callbacks);
 
+	if (IS_ENABLED(CONFIG_SC_CONN_PARAMS)) {
+		conn_params_init(conn_is_remote);
+	}
+
+	if (IS_ENABLED(CONFIG_SC_LINK_SETUP)) {
+		link_setup_init();
+	}
+
 	int (*module_init[])(void) = {scan_init, nus_client_init};
 	for (size_t i = 0; i < ARRAY_SIZE(module_init); i++) {
 		err = (*module_init[i])();
@@ -364,16 +937,10 @@ int app_ble_nus_c_init(app_ble_nus_c_config_t *config)
 		}
 	}
 
-	printk("Starting Bluetooth Central UART example\n");
-
-
-	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-	if (err) {
-		LOG_ERR("Scanning failed to start (err %d)", err);
-		return err;
-	}
+	LOG_INF("Starting Bluetooth Central UART example");
 
-	LOG_INF("Scanning successfully started");
+	// Builds the accept list from the bonds loaded with the settings
+	reconnect_start();
 
 	return 0;
 }
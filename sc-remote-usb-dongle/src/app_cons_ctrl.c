@@ -0,0 +1,181 @@
+#include "app_cons_ctrl.h"
+#include "app_usb_hid.h"
+#include "app_latency.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <sc_hid.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_cons_ctrl, CONFIG_SC_LOG_LEVEL);
+
+struct cons_slot {
+	uint16_t usage;
+	bool repeat;
+};
+
+static struct cons_slot m_slots[APP_KBD_SOURCE_COUNT][APP_KBD_SLOT_COUNT];
+
+// Merged state last sent to the host
+static uint16_t m_usages[SC_HID_CONS_CTRL_SLOTS];
+static uint8_t m_count;
+// Usages of m_usages that repeat while held
+static uint8_t m_repeat_mask;
+
+static K_MUTEX_DEFINE(m_cons_ctrl_mutex);
+
+static void repeat_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_repeat_work, repeat_work_handler);
+
+static int merge_index(const uint16_t *usages, uint8_t count, uint16_t usage)
+{
+	for (int i = 0; i < count; i++) {
+		if (usages[i] == usage) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Called with the mutex held
+static int cons_ctrl_update(uint8_t source, bool changes_only)
+{
+	uint16_t usages[SC_HID_CONS_CTRL_SLOTS];
+	uint8_t count = 0;
+	uint8_t repeat_mask = 0;
+	bool new_repeat = false;
+	int ret = 0;
+
+	// Merge the usages held by every source, the same usage only once
+	for (int i = 0; i < APP_KBD_SOURCE_COUNT; i++) {
+		for (int j = 0; j < APP_KBD_SLOT_COUNT; j++) {
+			const struct cons_slot *slot = &m_slots[i][j];
+			int index;
+
+			if (!slot->usage) {
+				continue;
+			}
+
+			index = merge_index(usages, count, slot->usage);
+			if (index < 0) {
+				if (count == ARRAY_SIZE(usages)) {
+					LOG_WRN("Consumer usage 0x%03x not reported, all slots held",
+						slot->usage);
+					continue;
+				}
+				index = count;
+				usages[count++] = slot->usage;
+			}
+			if (slot->repeat) {
+				repeat_mask |= BIT(index);
+			}
+		}
+	}
+
+	if (changes_only && (count == m_count) &&
+	    !memcmp(usages, m_usages, count * sizeof(usages[0]))) {
+		m_repeat_mask = repeat_mask;
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if ((repeat_mask & BIT(i)) && (merge_index(m_usages, m_count, usages[i]) < 0)) {
+			new_repeat = true;
+		}
+	}
+
+	ret = app_usb_hid_send_cons_ctrl_state(source, usages, count);
+	if (ret) {
+		LOG_WRN("Consumer control report not queued (err %d)", ret);
+		return ret;
+	}
+
+	memcpy(m_usages, usages, count * sizeof(usages[0]));
+	m_count = count;
+	m_repeat_mask = repeat_mask;
+
+	// A newly pressed usage starts the repeat delay over, like on a keyboard
+	if (!repeat_mask || !CONFIG_SC_DONGLE_CONS_REPEAT_INTERVAL_MS) {
+		k_work_cancel_delayable(&m_repeat_work);
+	} else if (new_repeat) {
+		k_work_reschedule(&m_repeat_work, K_MSEC(CONFIG_SC_DONGLE_CONS_REPEAT_DELAY_MS));
+	}
+	return 0;
+}
+
+static void repeat_work_handler(struct k_work *work)
+{
+	uint16_t usages[SC_HID_CONS_CTRL_SLOTS];
+	uint8_t count = 0;
+	int err;
+
+	k_mutex_lock(&m_cons_ctrl_mutex, K_FOREVER);
+
+	if (!m_repeat_mask) {
+		k_mutex_unlock(&m_cons_ctrl_mutex);
+		return;
+	}
+
+	// Release the repeating usages for one report, then press them again
+	for (int i = 0; i < m_count; i++) {
+		if (!(m_repeat_mask & BIT(i))) {
+			usages[count++] = m_usages[i];
+		}
+	}
+
+	err = app_usb_hid_send_cons_ctrl_state(APP_LATENCY_SOURCE_NONE, usages, count);
+	if (!err) {
+		err = app_usb_hid_send_cons_ctrl_state(APP_LATENCY_SOURCE_NONE, m_usages, m_count);
+	}
+	if (err) {
+		LOG_WRN("Consumer control repeat not queued (err %d)", err);
+	}
+
+	k_work_reschedule(&m_repeat_work, K_MSEC(CONFIG_SC_DONGLE_CONS_REPEAT_INTERVAL_MS));
+	k_mutex_unlock(&m_cons_ctrl_mutex);
+}
+
+int app_cons_ctrl_press(uint8_t source, uint8_t slot, uint16_t usage, bool repeat)
+{
+	int ret;
+
+	if ((source >= APP_KBD_SOURCE_COUNT) || (slot >= APP_KBD_SLOT_COUNT) ||
+	    (usage > SC_HID_CONS_USAGE_MAX)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&m_cons_ctrl_mutex, K_FOREVER);
+	m_slots[source][slot] = (struct cons_slot){.usage = usage, .repeat = repeat};
+	ret = cons_ctrl_update(source, true);
+	k_mutex_unlock(&m_cons_ctrl_mutex);
+	return ret;
+}
+
+int app_cons_ctrl_release(uint8_t source, uint8_t slot)
+{
+	return app_cons_ctrl_press(source, slot, 0, false);
+}
+
+void app_cons_ctrl_release_all(uint8_t source)
+{
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		return;
+	}
+
+	k_mutex_lock(&m_cons_ctrl_mutex, K_FOREVER);
+	memset(m_slots[source], 0, sizeof(m_slots[source]));
+	cons_ctrl_update(source, true);
+	k_mutex_unlock(&m_cons_ctrl_mutex);
+}
+
+int app_cons_ctrl_refresh(void)
+{
+	int ret;
+
+	k_mutex_lock(&m_cons_ctrl_mutex, K_FOREVER);
+	ret = cons_ctrl_update(APP_LATENCY_SOURCE_NONE, false);
+	k_mutex_unlock(&m_cons_ctrl_mutex);
+	return ret;
+}
@@ -0,0 +1,204 @@
+#include "app_gatt_cache.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+
+#include <settings/settings.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_gatt_cache, CONFIG_SC_LOG_LEVEL);
+
+#define SETTINGS_SUBTREE "nus_cache"
+// Subtree, separator, 12 hex digits of address and the address type
+#define SETTINGS_KEY_LEN (sizeof(SETTINGS_SUBTREE) + 1 + 12 + 3 + 1)
+
+// Flash writes and page erases stay off the Bluetooth RX thread
+#define SAVE_DELAY K_MSEC(500)
+
+static struct app_gatt_cache_entry m_entries[CONFIG_BT_MAX_PAIRED];
+static uint8_t m_next_victim;
+
+// Entries changed since they were last persisted, one bit each
+static atomic_t m_unsaved;
+// Address each entry is stored under in settings, if any
+static bt_addr_le_t m_stored_addr[CONFIG_BT_MAX_PAIRED];
+static bool m_stored[CONFIG_BT_MAX_PAIRED];
+// Entries are changed on the Bluetooth RX thread and persisted from the work queue
+static struct k_spinlock m_lock;
+
+static void save_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_save_work, save_work_handler);
+
+static void settings_key(const bt_addr_le_t *addr, char *key, size_t len)
+{
+	snprintk(key, len, SETTINGS_SUBTREE "/%02x%02x%02x%02x%02x%02x%u",
+		 addr->a.val[5], addr->a.val[4], addr->a.val[3],
+		 addr->a.val[2], addr->a.val[1], addr->a.val[0], addr->type);
+}
+
+static void entry_changed(const struct app_gatt_cache_entry *entry)
+{
+	atomic_set_bit(&m_unsaved, entry - m_entries);
+	k_work_reschedule(&m_save_work, SAVE_DELAY);
+}
+
+/*
+ * Deletes go first, so that an address that moved to another entry is not
+ * deleted after it was stored again.
+ */
+static void save_work_handler(struct k_work *work)
+{
+	static struct app_gatt_cache_entry entries[ARRAY_SIZE(m_entries)];
+	bool save[ARRAY_SIZE(m_entries)] = {0};
+	char key[SETTINGS_KEY_LEN];
+	k_spinlock_key_t lock_key;
+	int err;
+
+	for (int i = 0; i < ARRAY_SIZE(m_entries); i++) {
+		if (!atomic_test_and_clear_bit(&m_unsaved, i)) {
+			continue;
+		}
+
+		lock_key = k_spin_lock(&m_lock);
+		entries[i] = m_entries[i];
+		k_spin_unlock(&m_lock, lock_key);
+
+		if (m_stored[i] && (!entries[i].in_use ||
+				    bt_addr_le_cmp(&m_stored_addr[i], &entries[i].addr))) {
+			settings_key(&m_stored_addr[i], key, sizeof(key));
+			settings_delete(key);
+			m_stored[i] = false;
+		}
+		save[i] = entries[i].in_use;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(m_entries); i++) {
+		if (!save[i]) {
+			continue;
+		}
+
+		settings_key(&entries[i].addr, key, sizeof(key));
+		err = settings_save_one(key, &entries[i], sizeof(entries[i]));
+		if (err) {
+			LOG_WRN("Failed to store NUS handles (err %d)", err);
+			continue;
+		}
+		bt_addr_le_copy(&m_stored_addr[i], &entries[i].addr);
+		m_stored[i] = true;
+	}
+}
+
+static struct app_gatt_cache_entry *entry_find(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(m_entries); i++) {
+		if (m_entries[i].in_use && !bt_addr_le_cmp(&m_entries[i].addr, addr)) {
+			return &m_entries[i];
+		}
+	}
+	return NULL;
+}
+
+static struct app_gatt_cache_entry *entry_alloc(void)
+{
+	struct app_gatt_cache_entry *entry;
+
+	for (int i = 0; i < ARRAY_SIZE(m_entries); i++) {
+		if (!m_entries[i].in_use) {
+			return &m_entries[i];
+		}
+	}
+
+	// Full, which only happens if bonds were removed behind our back
+	entry = &m_entries[m_next_victim];
+	m_next_victim = (m_next_victim + 1) % ARRAY_SIZE(m_entries);
+	app_gatt_cache_invalidate(&entry->addr);
+	return entry;
+}
+
+const struct app_gatt_cache_entry *app_gatt_cache_find(const bt_addr_le_t *addr)
+{
+	return entry_find(addr);
+}
+
+int app_gatt_cache_store(const bt_addr_le_t *addr,
+			 const struct bt_nus_client_handles *handles,
+			 const uint8_t *db_hash)
+{
+	struct app_gatt_cache_entry *entry = entry_find(addr);
+	k_spinlock_key_t key;
+
+	if (!entry) {
+		entry = entry_alloc();
+	}
+
+	key = k_spin_lock(&m_lock);
+	memset(entry, 0, sizeof(*entry));
+	bt_addr_le_copy(&entry->addr, addr);
+	entry->handles = *handles;
+	if (db_hash) {
+		memcpy(entry->db_hash, db_hash, sizeof(entry->db_hash));
+		entry->db_hash_valid = true;
+	}
+	entry->in_use = true;
+	k_spin_unlock(&m_lock, key);
+
+	// Used from now on, persisted later
+	entry_changed(entry);
+	return 0;
+}
+
+void app_gatt_cache_invalidate(const bt_addr_le_t *addr)
+{
+	struct app_gatt_cache_entry *entry = entry_find(addr);
+	k_spinlock_key_t key;
+
+	if (!entry) {
+		return;
+	}
+
+	key = k_spin_lock(&m_lock);
+	entry->in_use = false;
+	k_spin_unlock(&m_lock, key);
+
+	entry_changed(entry);
+}
+
+static int gatt_cache_set(const char *name, size_t len, settings_read_cb read_cb,
+			  void *cb_arg)
+{
+	struct app_gatt_cache_entry tmp;
+	struct app_gatt_cache_entry *entry;
+	ssize_t ret;
+
+	if (len != sizeof(tmp)) {
+		LOG_WRN("Ignoring cache entry %s of unexpected size", log_strdup(name));
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, &tmp, sizeof(tmp));
+	if (ret < 0) {
+		return ret;
+	}
+
+	entry = entry_find(&tmp.addr);
+	if (!entry) {
+		entry = entry_alloc();
+	}
+	*entry = tmp;
+	entry->in_use = true;
+
+	// Already stored under this address. An entry that took the place of
+	// another one is stored again, once the evicted one is deleted.
+	if (!m_stored[entry - m_entries]) {
+		bt_addr_le_copy(&m_stored_addr[entry - m_entries], &tmp.addr);
+		m_stored[entry - m_entries] = true;
+		atomic_clear_bit(&m_unsaved, entry - m_entries);
+	}
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(nus_cache, SETTINGS_SUBTREE, NULL, gatt_cache_set,
+			       NULL, NULL);
@@ -0,0 +1,102 @@
+#include "app_hid_capture.h"
+#include "app_usb_hid.h"
+
+#include <sc_hid.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_hid_capture, CONFIG_SC_LOG_LEVEL);
+
+#define POLL_INTERVAL	K_USEC(CONFIG_SC_DONGLE_HID_CAPTURE_POLL_US)
+#define SUMMARY_INTERVAL	K_SECONDS(CONFIG_SC_DONGLE_HID_CAPTURE_SUMMARY_INTERVAL)
+#define EP_SIZE		16
+
+static app_hid_capture_ready_t m_in_ready_cb;
+
+// The IN endpoint buffers, full until the host has read them
+static struct {
+	uint8_t buf[EP_SIZE];
+	uint32_t len;
+	atomic_t full;
+} m_ep[APP_HID_CAPTURE_EP_COUNT];
+
+static struct {
+	uint32_t reports;
+	uint32_t kbd;
+	uint32_t cons_ctrl;
+} m_capture;
+static uint32_t m_summary_reports;
+
+static void host_poll(struct k_timer *timer)
+{
+	for (uint8_t ep = 0; ep < APP_HID_CAPTURE_EP_COUNT; ep++) {
+		if (!atomic_get(&m_ep[ep].full)) {
+			continue;
+		}
+
+		m_capture.reports++;
+		// The first byte is the report ID
+		if (m_ep[ep].buf[0] == SC_HID_REPORT_ID_KBD) {
+			m_capture.kbd++;
+		} else {
+			m_capture.cons_ctrl++;
+		}
+		LOG_HEXDUMP_DBG(m_ep[ep].buf, m_ep[ep].len, "report");
+
+		atomic_clear(&m_ep[ep].full);
+		m_in_ready_cb(ep);
+	}
+}
+
+static K_TIMER_DEFINE(m_host_poll_timer, host_poll, NULL);
+
+// Periodic summary, picked up by scripts/bsim_run.sh
+static void summary_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_summary_work, summary_work_handler);
+
+static void summary_work_handler(struct k_work *work)
+{
+	struct app_usb_hid_stats stats;
+	uint32_t reports = m_capture.reports;
+
+	app_usb_hid_stats_get(&stats);
+
+	LOG_INF("sim: hid %u reports (%u kbd, %u cons), %u/s, %u direct, "
+		"%u queued, %u coalesced, %u dropped",
+		reports, m_capture.kbd, m_capture.cons_ctrl,
+		(reports - m_summary_reports) / CONFIG_SC_DONGLE_HID_CAPTURE_SUMMARY_INTERVAL,
+		stats.direct, stats.queued, stats.coalesced, stats.dropped);
+
+	m_summary_reports = reports;
+	k_work_schedule(&m_summary_work, SUMMARY_INTERVAL);
+}
+
+void app_hid_capture_init(app_hid_capture_ready_t in_ready_cb)
+{
+	m_in_ready_cb = in_ready_cb;
+	k_timer_start(&m_host_poll_timer, POLL_INTERVAL, POLL_INTERVAL);
+	k_work_schedule(&m_summary_work, SUMMARY_INTERVAL);
+}
+
+int app_hid_capture_write(uint8_t ep, const uint8_t *data, uint32_t size, uint32_t *bytes_ret)
+{
+	if ((ep >= APP_HID_CAPTURE_EP_COUNT) || (size > sizeof(m_ep[ep].buf))) {
+		return -EINVAL;
+	}
+
+	if (atomic_get(&m_ep[ep].full)) {
+		return -EAGAIN;
+	}
+
+	memcpy(m_ep[ep].buf, data, size);
+	m_ep[ep].len = size;
+	atomic_set(&m_ep[ep].full, 1);
+
+	if (bytes_ret) {
+		*bytes_ret = size;
+	}
+	return 0;
+}
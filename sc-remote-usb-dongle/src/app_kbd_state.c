@@ -0,0 +1,119 @@
+#include "app_kbd_state.h"
+#include "app_usb_hid.h"
+#include "app_latency.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_kbd_state, CONFIG_SC_LOG_LEVEL);
+
+struct kbd_source {
+	struct app_kbd_action pending[APP_KBD_SLOT_COUNT];
+	struct app_kbd_action active[APP_KBD_SLOT_COUNT];
+};
+
+static struct kbd_source m_sources[APP_KBD_SOURCE_COUNT];
+
+// Merged state last sent to the host
+static uint8_t m_modifiers;
+static uint32_t m_key_bitmap[APP_USB_HID_KEY_BITMAP_WORDS];
+
+static K_MUTEX_DEFINE(m_kbd_state_mutex);
+
+static inline bool action_is_held(const struct app_kbd_action *action)
+{
+	return action->key || action->modifiers;
+}
+
+int app_kbd_state_press(uint8_t source, uint8_t slot, struct app_kbd_action action)
+{
+	if ((source >= APP_KBD_SOURCE_COUNT) || (slot >= APP_KBD_SLOT_COUNT)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&m_kbd_state_mutex, K_FOREVER);
+	m_sources[source].pending[slot] = action;
+	k_mutex_unlock(&m_kbd_state_mutex);
+	return 0;
+}
+
+int app_kbd_state_release(uint8_t source, uint8_t slot)
+{
+	return app_kbd_state_press(source, slot, (struct app_kbd_action){0});
+}
+
+void app_kbd_state_release_all(uint8_t source)
+{
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		return;
+	}
+
+	k_mutex_lock(&m_kbd_state_mutex, K_FOREVER);
+	memset(m_sources[source].pending, 0, sizeof(m_sources[source].pending));
+	k_mutex_unlock(&m_kbd_state_mutex);
+}
+
+// Called with the mutex held
+static int kbd_state_send(uint8_t source, bool changes_only)
+{
+	uint32_t key_bitmap[APP_USB_HID_KEY_BITMAP_WORDS] = {0};
+	uint8_t modifiers = 0;
+	int ret = 0;
+
+	// Merge the keys held by every source
+	for (int i = 0; i < APP_KBD_SOURCE_COUNT; i++) {
+		for (int j = 0; j < APP_KBD_SLOT_COUNT; j++) {
+			const struct app_kbd_action *action = &m_sources[i].active[j];
+
+			if (!action_is_held(action)) {
+				continue;
+			}
+			modifiers |= action->modifiers;
+			if (action->key) {
+				key_bitmap[action->key / 32] |= BIT(action->key % 32);
+			}
+		}
+	}
+
+	// Only changes are sent to the host, unless it asked for the state again
+	if (!changes_only || (modifiers != m_modifiers) ||
+	    memcmp(key_bitmap, m_key_bitmap, sizeof(key_bitmap))) {
+		ret = app_usb_hid_send_kbd_state(source, modifiers, key_bitmap);
+		if (ret == 0) {
+			m_modifiers = modifiers;
+			memcpy(m_key_bitmap, key_bitmap, sizeof(m_key_bitmap));
+		} else {
+			LOG_WRN("Keyboard report not queued (err %d)", ret);
+		}
+	}
+
+	return ret;
+}
+
+int app_kbd_state_commit(uint8_t source)
+{
+	int ret;
+
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&m_kbd_state_mutex, K_FOREVER);
+	memcpy(m_sources[source].active, m_sources[source].pending,
+	       sizeof(m_sources[source].active));
+	ret = kbd_state_send(source, true);
+	k_mutex_unlock(&m_kbd_state_mutex);
+	return ret;
+}
+
+int app_kbd_state_refresh(void)
+{
+	int ret;
+
+	k_mutex_lock(&m_kbd_state_mutex, K_FOREVER);
+	ret = kbd_state_send(APP_LATENCY_SOURCE_NONE, false);
+	k_mutex_unlock(&m_kbd_state_mutex);
+	return ret;
+}
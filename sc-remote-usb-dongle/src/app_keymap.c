@@ -0,0 +1,204 @@
+#include "app_keymap.h"
+#include "app_usb_hid.h"
+
+#include <sc_hid.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/byteorder.h>
+
+#include <settings/settings.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_keymap, CONFIG_SC_LOG_LEVEL);
+
+#define SETTINGS_SUBTREE "keymap"
+#define SETTINGS_NAME_MAP "map2"
+#define SETTINGS_KEY_MAP SETTINGS_SUBTREE "/" SETTINGS_NAME_MAP
+// Maps stored before consumer usages were 16-bit codes, deleted when found
+#define SETTINGS_NAME_MAP_OLD "map"
+#define SETTINGS_KEY_MAP_OLD SETTINGS_SUBTREE "/" SETTINGS_NAME_MAP_OLD
+
+// Flash writes and page erases stay off the Bluetooth RX thread
+#define SAVE_DELAY K_MSEC(500)
+
+typedef struct app_keymap_action keymap_t[APP_KEYMAP_SOURCE_COUNT][APP_KEYMAP_BUTTON_COUNT][APP_KEYMAP_EVT_COUNT];
+
+#define KEY_PRESS(mod, key) {.type = APP_KEYMAP_ACTION_KEY_PRESS, .modifiers = (mod), .usage = (key)}
+#define KEY_RELEASE {.type = APP_KEYMAP_ACTION_KEY_RELEASE}
+#define CONS_PRESS(flags, usage) {.type = APP_KEYMAP_ACTION_CONS_PRESS, .modifiers = (flags), .usage = (usage)}
+#define CONS_RELEASE {.type = APP_KEYMAP_ACTION_CONS_RELEASE}
+
+#define DEFAULT_BUTTONS { \
+	/* Volume up */ \
+	[0] = {CONS_PRESS(APP_KEYMAP_CONS_FLAG_REPEAT, SC_HID_CONS_VOLUME_UP), CONS_RELEASE}, \
+	/* Volume down */ \
+	[1] = {CONS_PRESS(APP_KEYMAP_CONS_FLAG_REPEAT, SC_HID_CONS_VOLUME_DOWN), CONS_RELEASE}, \
+	/* Hold an incrementing character (a-z) for as long as the button is pressed */ \
+	[2] = {{.type = APP_KEYMAP_ACTION_LETTER_CYCLE}, KEY_RELEASE}, \
+	/* Hold CTRL + SHIFT + M for as long as the button is pressed */ \
+	[3] = {KEY_PRESS(HID_KBD_REP_FLAG_LEFT_CTRL | HID_KBD_REP_FLAG_LEFT_SHIFT, KEY_M), KEY_RELEASE}, \
+}
+
+static const keymap_t m_default_map = {
+	[APP_KEYMAP_SOURCE_LOCAL] = DEFAULT_BUTTONS,
+	[APP_KEYMAP_SOURCE_REMOTE] = DEFAULT_BUTTONS,
+};
+
+static keymap_t m_map;
+
+// Lookups come from both the BLE RX thread and the button handler
+static struct k_spinlock m_map_lock;
+
+void app_keymap_init(void)
+{
+	app_keymap_reset();
+}
+
+struct app_keymap_action app_keymap_lookup(uint8_t source, uint8_t button, uint8_t event)
+{
+	struct app_keymap_action action = {.type = APP_KEYMAP_ACTION_NONE};
+	k_spinlock_key_t key;
+
+	if ((source >= APP_KEYMAP_SOURCE_COUNT) || (button >= APP_KEYMAP_BUTTON_COUNT) ||
+	    (event >= APP_KEYMAP_EVT_COUNT)) {
+		return action;
+	}
+
+	key = k_spin_lock(&m_map_lock);
+	action = m_map[source][button][event];
+	k_spin_unlock(&m_map_lock, key);
+
+	return action;
+}
+
+bool app_keymap_entry_valid(const struct app_keymap_entry *entry)
+{
+	if ((entry->type == APP_KEYMAP_ACTION_CONS_PRESS) &&
+	    (sys_le16_to_cpu(entry->usage) > SC_HID_CONS_USAGE_MAX)) {
+		return false;
+	}
+
+	return (entry->source < APP_KEYMAP_SOURCE_COUNT) &&
+	       (entry->button < APP_KEYMAP_BUTTON_COUNT) &&
+	       (entry->event < APP_KEYMAP_EVT_COUNT) &&
+	       (entry->type < APP_KEYMAP_ACTION_COUNT);
+}
+
+int app_keymap_set(const struct app_keymap_entry *entry)
+{
+	struct app_keymap_action action;
+	k_spinlock_key_t key;
+
+	if (!app_keymap_entry_valid(entry)) {
+		return -EINVAL;
+	}
+
+	action.type = entry->type;
+	action.modifiers = entry->modifiers;
+	action.usage = sys_le16_to_cpu(entry->usage);
+
+	key = k_spin_lock(&m_map_lock);
+	m_map[entry->source][entry->button][entry->event] = action;
+	k_spin_unlock(&m_map_lock, key);
+
+	return 0;
+}
+
+void app_keymap_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_map_lock);
+
+	memcpy(m_map, m_default_map, sizeof(m_map));
+	k_spin_unlock(&m_map_lock, key);
+}
+
+void app_keymap_get(struct app_keymap_action *map, size_t count)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_map_lock);
+
+	memcpy(map, m_map, MIN(count * sizeof(*map), sizeof(m_map)));
+	k_spin_unlock(&m_map_lock, key);
+}
+
+#if defined(CONFIG_SETTINGS)
+static void save_work_handler(struct k_work *work)
+{
+	static keymap_t snapshot;
+	int err;
+
+	app_keymap_get(&snapshot[0][0][0], sizeof(snapshot) / sizeof(struct app_keymap_action));
+
+	err = settings_save_one(SETTINGS_KEY_MAP, snapshot, sizeof(snapshot));
+	if (err) {
+		LOG_WRN("Failed to store key map (err %d)", err);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(m_save_work, save_work_handler);
+
+static void delete_old_work_handler(struct k_work *work)
+{
+	int err = settings_delete(SETTINGS_KEY_MAP_OLD);
+
+	if (err) {
+		LOG_WRN("Failed to delete old key map (err %d)", err);
+	} else {
+		LOG_INF("Old key map deleted");
+	}
+}
+
+static K_WORK_DEFINE(m_delete_old_work, delete_old_work_handler);
+
+int app_keymap_save(void)
+{
+	// Writes of several entries in a row end up in one flash write
+	k_work_reschedule(&m_save_work, SAVE_DELAY);
+	return 0;
+}
+
+static int keymap_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+			       void *cb_arg)
+{
+	static keymap_t stored;
+	k_spinlock_key_t key;
+	ssize_t ret;
+
+	// Not usable with the current actions, and would take flash forever
+	if (!strcmp(name, SETTINGS_NAME_MAP_OLD)) {
+		k_work_submit(&m_delete_old_work);
+		return 0;
+	}
+
+	if (strcmp(name, SETTINGS_NAME_MAP)) {
+		return -ENOENT;
+	}
+
+	// A map stored by a build with a different layout is ignored
+	if (len != sizeof(stored)) {
+		LOG_WRN("Ignoring stored key map of unexpected size");
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, stored, sizeof(stored));
+	if (ret < 0) {
+		return ret;
+	}
+
+	key = k_spin_lock(&m_map_lock);
+	memcpy(m_map, stored, sizeof(m_map));
+	k_spin_unlock(&m_map_lock, key);
+
+	LOG_INF("Key map loaded from settings");
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(keymap, SETTINGS_SUBTREE, NULL, keymap_settings_set,
+			       NULL, NULL);
+#else
+int app_keymap_save(void)
+{
+	return -ENOTSUP;
+}
+#endif
@@ -0,0 +1,130 @@
+#include "app_keymap_service.h"
+#include "app_keymap.h"
+#include "app_macro.h"
+
+#include <errno.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/uuid.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_keymap_service, CONFIG_SC_LOG_LEVEL);
+
+#define KEYMAP_CMD_RESET	0x00
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+};
+
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_SC_CONFIG_SERVICE_VAL),
+};
+
+static ssize_t keymap_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			   void *buf, uint16_t len, uint16_t offset)
+{
+	struct app_keymap_action map[APP_KEYMAP_SOURCE_COUNT * APP_KEYMAP_BUTTON_COUNT *
+				     APP_KEYMAP_EVT_COUNT];
+
+	app_keymap_get(map, ARRAY_SIZE(map));
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, map, sizeof(map));
+}
+
+/*
+ * A write is either a list of struct app_keymap_entry, or the single byte
+ * KEYMAP_CMD_RESET to go back to the default map. Entries are checked before
+ * any of them is applied, so a bad write leaves the map untouched.
+ */
+static ssize_t keymap_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const struct app_keymap_entry *entries = buf;
+	size_t count = len / sizeof(struct app_keymap_entry);
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if ((len == 1) && (((const uint8_t *)buf)[0] == KEYMAP_CMD_RESET)) {
+		LOG_INF("Key map reset to defaults");
+		app_keymap_reset();
+		app_keymap_save();
+		return len;
+	}
+
+	if (!count || (len % sizeof(struct app_keymap_entry))) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (!app_keymap_entry_valid(&entries[i])) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		app_keymap_set(&entries[i]);
+	}
+	app_keymap_save();
+
+	LOG_INF("Key map updated, %u entries", count);
+	return len;
+}
+
+#if defined(CONFIG_SC_DONGLE_MACRO)
+// A write is the macro index, the offset to write at and the macro data
+static ssize_t macro_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			   const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const uint8_t *data = buf;
+
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (len < 2) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	if (app_macro_write(data[0], data[1], &data[2], len - 2)) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+#endif
+
+BT_GATT_SERVICE_DEFINE(sc_config_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_SC_CONFIG_SERVICE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_SC_CONFIG_KEYMAP,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_READ_AUTHEN | BT_GATT_PERM_WRITE_AUTHEN,
+			       keymap_read, keymap_write, NULL),
+#if defined(CONFIG_SC_DONGLE_MACRO)
+	BT_GATT_CHARACTERISTIC(BT_UUID_SC_CONFIG_MACRO,
+			       BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_WRITE_AUTHEN,
+			       NULL, macro_write, NULL),
+#endif
+);
+
+int app_keymap_service_init(void)
+{
+	// Slow advertising, the service is only used now and then to set up the dongle
+	int err = bt_le_adv_start(BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE,
+						  BT_GAP_ADV_SLOW_INT_MIN,
+						  BT_GAP_ADV_SLOW_INT_MAX, NULL),
+				  ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	if (err) {
+		LOG_ERR("Advertising failed to start (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("Configuration service advertising");
+	return 0;
+}
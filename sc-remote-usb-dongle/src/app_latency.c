@@ -0,0 +1,213 @@
+#include "app_latency.h"
+
+#include <sc_protocol.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_latency, CONFIG_SC_LOG_LEVEL);
+
+// Window for the minimum clock offset, short enough to ride out crystal drift
+#define LINK_WINDOW_MS 10000
+
+static const char *const stage_name[APP_LATENCY_STAGE_COUNT] = {
+	[APP_LATENCY_STAGE_REMOTE] = "remote",
+	[APP_LATENCY_STAGE_LINK] = "link",
+	[APP_LATENCY_STAGE_DECODE] = "decode",
+	[APP_LATENCY_STAGE_QUEUE] = "queue",
+	[APP_LATENCY_STAGE_USB] = "usb",
+	[APP_LATENCY_STAGE_TOTAL] = "total",
+};
+
+static struct latency_hist m_hist[APP_LATENCY_STAGE_COUNT];
+
+// Stamps of the event each source is currently turning into reports. Remotes
+// are decoded on the BLE RX thread, the local buttons on the system work
+// queue, so each source keeps its own.
+static struct {
+	uint32_t rx;
+	uint32_t link_us;
+	uint32_t upstream_us;
+	bool valid;
+} m_current[APP_KBD_SOURCE_COUNT];
+
+// Histograms are added to from the RX thread, the work queue and USB completion
+static struct k_spinlock m_lock;
+
+static void hist_add(enum app_latency_stage stage, uint32_t us)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	latency_hist_add(&m_hist[stage], us);
+	k_spin_unlock(&m_lock, key);
+}
+
+static inline uint32_t cyc_since_us(uint32_t start, uint32_t end)
+{
+	return k_cyc_to_us_floor32(end - start);
+}
+
+void app_latency_frame_rx(uint8_t source, struct app_latency_link *link,
+			  uint16_t remote_timestamp)
+{
+	uint32_t now_ms = k_uptime_get_32();
+	uint16_t offset = (uint16_t)now_ms - remote_timestamp;
+	int16_t rel;
+
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		return;
+	}
+
+	m_current[source].rx = k_cycle_get_32();
+
+	if (!link->valid) {
+		link->base_offset = offset;
+		link->min_offset = 0;
+		link->prev_min_offset = 0;
+		link->window_start = now_ms;
+		link->valid = true;
+	}
+
+	rel = (int16_t)(offset - link->base_offset);
+
+	if ((now_ms - link->window_start) > LINK_WINDOW_MS) {
+		link->prev_min_offset = link->min_offset;
+		link->min_offset = rel;
+		link->window_start = now_ms;
+	} else if (rel < link->min_offset) {
+		link->min_offset = rel;
+	}
+
+	m_current[source].link_us = (rel - MIN(link->min_offset, link->prev_min_offset)) * 1000U;
+	hist_add(APP_LATENCY_STAGE_LINK, m_current[source].link_us);
+}
+
+void app_latency_local_rx(uint8_t source)
+{
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		return;
+	}
+
+	m_current[source].rx = k_cycle_get_32();
+	m_current[source].link_us = 0;
+	m_current[source].upstream_us = 0;
+	m_current[source].valid = true;
+}
+
+void app_latency_event(uint8_t source, uint8_t age_ms)
+{
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		return;
+	}
+
+	// Saturated ages come from resyncs, the edge time is unknown
+	if (age_ms == SC_PROTO_EVT_AGE_MAX) {
+		m_current[source].valid = false;
+		return;
+	}
+
+	hist_add(APP_LATENCY_STAGE_REMOTE, age_ms * 1000U);
+	m_current[source].upstream_us = age_ms * 1000U + m_current[source].link_us;
+	m_current[source].valid = true;
+}
+
+void app_latency_link_reset(struct app_latency_link *link)
+{
+	link->valid = false;
+}
+
+void app_latency_tag_report(uint8_t source, struct app_latency_tag *tag)
+{
+	tag->queued = k_cycle_get_32();
+
+	// Repeats, refreshes and macros are not caused by a timed event
+	if (source >= APP_KBD_SOURCE_COUNT) {
+		tag->valid = false;
+		return;
+	}
+
+	tag->rx = m_current[source].rx;
+	tag->upstream_us = m_current[source].upstream_us;
+	tag->valid = m_current[source].valid;
+}
+
+void app_latency_submitted(struct app_latency_tag *tag)
+{
+	tag->submitted = k_cycle_get_32();
+}
+
+void app_latency_completed(struct app_latency_tag *tag)
+{
+	uint32_t now = k_cycle_get_32();
+	k_spinlock_key_t key;
+
+	if (!tag->valid) {
+		return;
+	}
+	tag->valid = false;
+
+	key = k_spin_lock(&m_lock);
+	latency_hist_add(&m_hist[APP_LATENCY_STAGE_DECODE], cyc_since_us(tag->rx, tag->queued));
+	latency_hist_add(&m_hist[APP_LATENCY_STAGE_QUEUE], cyc_since_us(tag->queued, tag->submitted));
+	latency_hist_add(&m_hist[APP_LATENCY_STAGE_USB], cyc_since_us(tag->submitted, now));
+	latency_hist_add(&m_hist[APP_LATENCY_STAGE_TOTAL],
+			 tag->upstream_us + cyc_since_us(tag->rx, now));
+	k_spin_unlock(&m_lock, key);
+}
+
+void app_latency_hist_get(enum app_latency_stage stage, struct latency_hist *hist)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	*hist = m_hist[stage];
+	k_spin_unlock(&m_lock, key);
+}
+
+const char *app_latency_stage_name(enum app_latency_stage stage)
+{
+	return stage_name[stage];
+}
+
+void app_latency_dump(void)
+{
+	// Copied one at a time, the log call must not run with the lock held
+	static struct latency_hist hist;
+
+	for (int i = 0; i < APP_LATENCY_STAGE_COUNT; i++) {
+		app_latency_hist_get(i, &hist);
+
+		LOG_INF("%-6s n=%u p50=%u p99=%u max=%u mean=%u us", stage_name[i],
+			hist.count, latency_hist_percentile(&hist, 50),
+			latency_hist_percentile(&hist, 99), hist.max,
+			latency_hist_mean(&hist));
+	}
+}
+
+void app_latency_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	for (int i = 0; i < APP_LATENCY_STAGE_COUNT; i++) {
+		latency_hist_reset(&m_hist[i]);
+	}
+	k_spin_unlock(&m_lock, key);
+}
+
+#if CONFIG_SC_DONGLE_LATENCY_DUMP_INTERVAL > 0
+static void dump_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_dump_work, dump_work_handler);
+
+static void dump_work_handler(struct k_work *work)
+{
+	app_latency_dump();
+	k_work_schedule(&m_dump_work, K_SECONDS(CONFIG_SC_DONGLE_LATENCY_DUMP_INTERVAL));
+}
+
+static int app_latency_dump_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+	k_work_schedule(&m_dump_work, K_SECONDS(CONFIG_SC_DONGLE_LATENCY_DUMP_INTERVAL));
+	return 0;
+}
+
+SYS_INIT(app_latency_dump_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif
@@ -0,0 +1,271 @@
+#include "app_macro.h"
+#include "app_kbd_state.h"
+#include "app_usb_hid.h"
+
+#include <errno.h>
+#include <sys/printk.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <settings/settings.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_macro, CONFIG_SC_LOG_LEVEL);
+
+#define SETTINGS_SUBTREE "macro"
+
+// Flash writes and page erases stay off the Bluetooth RX thread
+#define SAVE_DELAY K_MSEC(500)
+
+// The macro engine holds one key at a time
+#define MACRO_SLOT	0
+
+// Waiting longer than this for the host means it went away
+#define HOST_TIMEOUT_MS	(4 * CONFIG_SC_DONGLE_HID_EP_TIMEOUT_MS)
+
+#define SHIFT(usage)	((usage) | ASCII_SHIFT)
+#define ASCII_SHIFT	0x80
+
+static const uint8_t ascii_to_usage[128] = {
+	['\b'] = 0x2A, ['\t'] = 0x2B, ['\n'] = 0x28,
+	[' '] = 0x2C, ['!'] = SHIFT(0x1E), ['"'] = SHIFT(0x34), ['#'] = SHIFT(0x20),
+	['$'] = SHIFT(0x21), ['%'] = SHIFT(0x22), ['&'] = SHIFT(0x24), ['\''] = 0x34,
+	['('] = SHIFT(0x26), [')'] = SHIFT(0x27), ['*'] = SHIFT(0x25), ['+'] = SHIFT(0x2E),
+	[','] = 0x36, ['-'] = 0x2D, ['.'] = 0x37, ['/'] = 0x38,
+	['0'] = 0x27, ['1'] = 0x1E, ['2'] = 0x1F, ['3'] = 0x20,
+	['4'] = 0x21, ['5'] = 0x22, ['6'] = 0x23, ['7'] = 0x24,
+	['8'] = 0x25, ['9'] = 0x26, [':'] = SHIFT(0x33), [';'] = 0x33,
+	['<'] = SHIFT(0x36), ['='] = 0x2E, ['>'] = SHIFT(0x37), ['?'] = SHIFT(0x38),
+	['@'] = SHIFT(0x1F), ['A'] = SHIFT(0x04), ['B'] = SHIFT(0x05), ['C'] = SHIFT(0x06),
+	['D'] = SHIFT(0x07), ['E'] = SHIFT(0x08), ['F'] = SHIFT(0x09), ['G'] = SHIFT(0x0A),
+	['H'] = SHIFT(0x0B), ['I'] = SHIFT(0x0C), ['J'] = SHIFT(0x0D), ['K'] = SHIFT(0x0E),
+	['L'] = SHIFT(0x0F), ['M'] = SHIFT(0x10), ['N'] = SHIFT(0x11), ['O'] = SHIFT(0x12),
+	['P'] = SHIFT(0x13), ['Q'] = SHIFT(0x14), ['R'] = SHIFT(0x15), ['S'] = SHIFT(0x16),
+	['T'] = SHIFT(0x17), ['U'] = SHIFT(0x18), ['V'] = SHIFT(0x19), ['W'] = SHIFT(0x1A),
+	['X'] = SHIFT(0x1B), ['Y'] = SHIFT(0x1C), ['Z'] = SHIFT(0x1D), ['['] = 0x2F,
+	['\\'] = 0x31, [']'] = 0x30, ['^'] = SHIFT(0x23), ['_'] = SHIFT(0x2D),
+	['`'] = 0x35, ['a'] = 0x04, ['b'] = 0x05, ['c'] = 0x06,
+	['d'] = 0x07, ['e'] = 0x08, ['f'] = 0x09, ['g'] = 0x0A,
+	['h'] = 0x0B, ['i'] = 0x0C, ['j'] = 0x0D, ['k'] = 0x0E,
+	['l'] = 0x0F, ['m'] = 0x10, ['n'] = 0x11, ['o'] = 0x12,
+	['p'] = 0x13, ['q'] = 0x14, ['r'] = 0x15, ['s'] = 0x16,
+	['t'] = 0x17, ['u'] = 0x18, ['v'] = 0x19, ['w'] = 0x1A,
+	['x'] = 0x1B, ['y'] = 0x1C, ['z'] = 0x1D, ['{'] = SHIFT(0x2F),
+	['|'] = SHIFT(0x31), ['}'] = SHIFT(0x30), ['~'] = SHIFT(0x35),
+};
+
+struct macro {
+	uint16_t len;
+	uint8_t data[CONFIG_SC_DONGLE_MACRO_MAX_LEN];
+};
+
+static struct macro m_macros[CONFIG_SC_DONGLE_MACRO_COUNT];
+static K_MUTEX_DEFINE(m_macro_mutex);
+
+K_MSGQ_DEFINE(m_macro_queue, sizeof(uint8_t), 4, 1);
+
+// Usage held by the macro source, 0 if none
+static uint8_t m_held_usage;
+
+// Send the held state, and wait for the host to read it before the next step
+static int macro_commit(void)
+{
+	int err = app_kbd_state_commit(APP_KBD_SOURCE_MACRO);
+
+	if (err) {
+		return err;
+	}
+	return app_usb_hid_wait_idle(HOST_TIMEOUT_MS);
+}
+
+static int macro_release(void)
+{
+	m_held_usage = 0;
+	app_kbd_state_release(APP_KBD_SOURCE_MACRO, MACRO_SLOT);
+	return macro_commit();
+}
+
+/*
+ * Going straight from one key to another costs a single report, the host
+ * sees the first key released and the second pressed. Only a repeated key
+ * needs a release in between, or the host would see it held.
+ */
+static int macro_key(uint8_t modifiers, uint8_t usage)
+{
+	int err;
+
+	if (usage == m_held_usage) {
+		err = macro_release();
+		if (err) {
+			return err;
+		}
+	}
+
+	m_held_usage = usage;
+	app_kbd_state_press(APP_KBD_SOURCE_MACRO, MACRO_SLOT,
+			    (struct app_kbd_action){.modifiers = modifiers, .key = usage});
+	return macro_commit();
+}
+
+static int macro_run(const uint8_t *data, uint16_t len)
+{
+	int err = 0;
+
+	for (uint16_t i = 0; (i < len) && !err; i++) {
+		uint8_t step = data[i];
+
+		if (step == APP_MACRO_OP_KEY) {
+			if ((len - i) < 3) {
+				LOG_WRN("Truncated key step at %u", i);
+				break;
+			}
+			err = macro_key(data[i + 1], data[i + 2]);
+			i += 2;
+		} else if ((step < ARRAY_SIZE(ascii_to_usage)) && ascii_to_usage[step]) {
+			uint8_t usage = ascii_to_usage[step];
+
+			err = macro_key((usage & ASCII_SHIFT) ? HID_KBD_REP_FLAG_LEFT_SHIFT : 0,
+					usage & ~ASCII_SHIFT);
+		} else {
+			LOG_WRN("Skipping untypeable character 0x%02x", step);
+		}
+	}
+
+	if (err) {
+		LOG_WRN("Macro aborted (err %d)", err);
+	}
+
+	// Always leave the keyboard with nothing held
+	app_kbd_state_release_all(APP_KBD_SOURCE_MACRO);
+	app_kbd_state_commit(APP_KBD_SOURCE_MACRO);
+	m_held_usage = 0;
+
+	return err;
+}
+
+static void macro_thread_fn(void)
+{
+	static uint8_t data[CONFIG_SC_DONGLE_MACRO_MAX_LEN];
+	uint16_t len;
+	uint8_t index;
+
+	while (1) {
+		k_msgq_get(&m_macro_queue, &index, K_FOREVER);
+
+		k_mutex_lock(&m_macro_mutex, K_FOREVER);
+		len = m_macros[index].len;
+		memcpy(data, m_macros[index].data, len);
+		k_mutex_unlock(&m_macro_mutex);
+
+		LOG_DBG("Playing macro %u, %u bytes", index, len);
+		macro_run(data, len);
+	}
+}
+
+K_THREAD_DEFINE(m_macro_thread, 1024, macro_thread_fn, NULL, NULL, NULL, 6, 0, 0);
+
+int app_macro_play(uint8_t index)
+{
+	int err;
+
+	if (index >= CONFIG_SC_DONGLE_MACRO_COUNT) {
+		return -EINVAL;
+	}
+
+	err = k_msgq_put(&m_macro_queue, &index, K_NO_WAIT);
+	if (err) {
+		LOG_WRN("Macro queue full, macro %u dropped", index);
+	}
+	return err;
+}
+
+#if defined(CONFIG_SETTINGS)
+// Macros written since they were last stored, one bit each
+static atomic_t m_unsaved;
+
+static void save_work_handler(struct k_work *work)
+{
+	static uint8_t data[CONFIG_SC_DONGLE_MACRO_MAX_LEN];
+	char key[sizeof(SETTINGS_SUBTREE) + 4];
+	uint16_t len;
+	int err;
+
+	for (uint8_t i = 0; i < CONFIG_SC_DONGLE_MACRO_COUNT; i++) {
+		if (!atomic_test_and_clear_bit(&m_unsaved, i)) {
+			continue;
+		}
+
+		// Copied out, so playback is not held up by the flash write
+		k_mutex_lock(&m_macro_mutex, K_FOREVER);
+		len = m_macros[i].len;
+		memcpy(data, m_macros[i].data, len);
+		k_mutex_unlock(&m_macro_mutex);
+
+		snprintk(key, sizeof(key), SETTINGS_SUBTREE "/%u", i);
+		err = settings_save_one(key, data, len);
+		if (err) {
+			LOG_WRN("Failed to store macro %u (err %d)", i, err);
+		}
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(m_save_work, save_work_handler);
+#endif
+
+int app_macro_write(uint8_t index, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+	struct macro *macro;
+
+	if ((index >= CONFIG_SC_DONGLE_MACRO_COUNT) ||
+	    (offset + len > CONFIG_SC_DONGLE_MACRO_MAX_LEN)) {
+		return -EINVAL;
+	}
+
+	macro = &m_macros[index];
+
+	k_mutex_lock(&m_macro_mutex, K_FOREVER);
+
+	// Parts must be written in order
+	if (offset > macro->len) {
+		k_mutex_unlock(&m_macro_mutex);
+		return -EINVAL;
+	}
+
+	memcpy(&macro->data[offset], data, len);
+	macro->len = offset + len;
+
+	k_mutex_unlock(&m_macro_mutex);
+
+#if defined(CONFIG_SETTINGS)
+	// A macro written in parts is stored once, after the last part
+	atomic_set_bit(&m_unsaved, index);
+	k_work_reschedule(&m_save_work, SAVE_DELAY);
+#endif
+	return 0;
+}
+
+#if defined(CONFIG_SETTINGS)
+static int macro_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+			      void *cb_arg)
+{
+	unsigned long index = strtoul(name, NULL, 10);
+	ssize_t ret;
+
+	if ((index >= CONFIG_SC_DONGLE_MACRO_COUNT) || (len > CONFIG_SC_DONGLE_MACRO_MAX_LEN)) {
+		LOG_WRN("Ignoring stored macro %s", log_strdup(name));
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, m_macros[index].data, len);
+	if (ret < 0) {
+		return ret;
+	}
+	m_macros[index].len = ret;
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(macro, SETTINGS_SUBTREE, NULL, macro_settings_set,
+			       NULL, NULL);
+#endif
@@ -0,0 +1,155 @@
+#include "app_remote_protocol.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <sys/math_extras.h>
+
+#include <sc_protocol.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_remote_protocol, CONFIG_SC_LOG_LEVEL);
+
+static void apply_edge(struct app_remote_proto_rx *rx, uint8_t button,
+		       bool pressed, uint8_t age_ms)
+{
+	uint16_t mask = BIT(button);
+
+	// Duplicate edges carry no information, typically seen right after a resync
+	if (((rx->state & mask) != 0) == pressed) {
+		return;
+	}
+
+	rx->state ^= mask;
+	rx->stats.events++;
+	rx->on_event(rx, button, pressed, age_ms);
+}
+
+static int decode_legacy(struct app_remote_proto_rx *rx, const uint8_t *data)
+{
+	uint8_t button = data[0] - '0';
+
+	if (button > 3) {
+		rx->stats.malformed++;
+		return -EINVAL;
+	}
+
+	app_latency_local_rx(rx->source);
+	apply_edge(rx, button, data[1] == '1', 0);
+	return 0;
+}
+
+// Kept as is, only the readers look inside
+static int decode_stats(struct app_remote_proto_rx *rx, const uint8_t *data, uint16_t length)
+{
+	k_spinlock_key_t key;
+
+	if (length > SC_PROTO_STATS_MAX_SIZE) {
+		rx->stats.malformed++;
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&rx->diag_lock);
+	memcpy(rx->diag, data + 1, length - 1);
+	rx->diag_len = length - 1;
+	rx->diag_time = k_uptime_get_32();
+	k_spin_unlock(&rx->diag_lock, key);
+	return 0;
+}
+
+int app_remote_proto_decode(struct app_remote_proto_rx *rx,
+			    const uint8_t *data, uint16_t length)
+{
+	const struct sc_proto_hdr *hdr = (const struct sc_proto_hdr *)data;
+	const struct sc_proto_evt *evt;
+	uint16_t evt_count;
+	uint16_t state;
+	uint16_t diff;
+
+	if (length == SC_PROTO_LEGACY_SIZE) {
+		return decode_legacy(rx, data);
+	}
+
+	if ((length > 0) && (data[0] == SC_PROTO_STATS_BYTE)) {
+		return decode_stats(rx, data, length);
+	}
+
+	if ((length < SC_PROTO_HDR_SIZE) ||
+	    (hdr->version != SC_PROTO_VERSION_BYTE) ||
+	    ((length - SC_PROTO_HDR_SIZE) % SC_PROTO_EVT_SIZE) != 0) {
+		rx->stats.malformed++;
+		LOG_WRN("Malformed frame (len %u)", length);
+		return -EINVAL;
+	}
+
+	rx->stats.frames++;
+	app_latency_frame_rx(rx->source, &rx->latency, sys_le16_to_cpu(hdr->timestamp));
+
+	if (rx->synced && (hdr->seq != rx->next_seq)) {
+		rx->stats.lost_frames += (uint8_t)(hdr->seq - rx->next_seq);
+		LOG_WRN("Frame gap: expected %u, got %u", rx->next_seq, hdr->seq);
+	}
+	rx->next_seq = hdr->seq + 1;
+
+	// Fixed size records, so the events are walked without looking at the payload bytes
+	evt = (const struct sc_proto_evt *)(data + SC_PROTO_HDR_SIZE);
+	evt_count = (length - SC_PROTO_HDR_SIZE) / SC_PROTO_EVT_SIZE;
+	for (uint16_t i = 0; i < evt_count; i++) {
+		apply_edge(rx, evt[i].button & SC_PROTO_EVT_BUTTON_MASK,
+			   (evt[i].button & SC_PROTO_EVT_PRESSED) != 0,
+			   evt[i].age);
+	}
+
+	// Whatever the events could not explain was lost on the way. Bring the
+	// local view in line with the state bitmap so no key is left stuck.
+	state = sys_le16_to_cpu(hdr->state);
+	diff = rx->state ^ state;
+	if (diff && rx->synced) {
+		rx->stats.resyncs++;
+		LOG_WRN("Resync button state 0x%04x -> 0x%04x", rx->state, state);
+	}
+	while (diff) {
+		uint8_t button = u32_count_trailing_zeros(diff);
+
+		diff &= diff - 1;
+		apply_edge(rx, button, (state & BIT(button)) != 0,
+			   SC_PROTO_EVT_AGE_MAX);
+	}
+
+	rx->synced = true;
+	return 0;
+}
+
+void app_remote_proto_reset(struct app_remote_proto_rx *rx)
+{
+	uint16_t held = rx->state;
+	k_spinlock_key_t key;
+
+	while (held) {
+		uint8_t button = u32_count_trailing_zeros(held);
+
+		held &= held - 1;
+		apply_edge(rx, button, false, SC_PROTO_EVT_AGE_MAX);
+	}
+
+	rx->synced = false;
+	app_latency_link_reset(&rx->latency);
+
+	key = k_spin_lock(&rx->diag_lock);
+	rx->diag_len = 0;
+	k_spin_unlock(&rx->diag_lock, key);
+}
+
+uint8_t app_remote_proto_diag_get(struct app_remote_proto_rx *rx, uint8_t *buf,
+				  uint32_t *age_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&rx->diag_lock);
+	uint8_t len = rx->diag_len;
+
+	memcpy(buf, rx->diag, len);
+	*age_ms = k_uptime_get_32() - rx->diag_time;
+	k_spin_unlock(&rx->diag_lock, key);
+
+	return len;
+}
@@ -0,0 +1,305 @@
+#include "app_shell.h"
+#include "app_ble_nus_c_handler.h"
+#include "app_latency.h"
+#include "app_trace.h"
+#include "app_usb_hid.h"
+#include "app_usb_sof.h"
+
+#include <string.h>
+#include <sys/byteorder.h>
+
+#include <diag_service.h>
+#include <shell/shell.h>
+#include <bluetooth/conn.h>
+#if defined(CONFIG_SC_LINK_SETUP)
+#include <link_setup.h>
+#endif
+
+// Threads whose run time is remembered between two "sc threads"
+#define THREADS_MAX	24
+
+static struct app_remote_proto_rx *m_remote_rx;
+static uint8_t m_remote_count;
+
+void app_shell_init(struct app_remote_proto_rx *remote_rx, uint8_t count)
+{
+	m_remote_rx = remote_rx;
+	m_remote_count = count;
+}
+
+// Counters the remote sends about itself, the other records are left out
+static const struct {
+	uint8_t type;
+	const char *name;
+} m_remote_counters[] = {
+	{DIAG_TLV_UPTIME_MS, "uptime ms"},
+	{DIAG_TLV_EVENTS, "events"},
+	{DIAG_TLV_EVENTS_SENT, "events sent"},
+	{DIAG_TLV_FRAMES, "frames"},
+	{DIAG_TLV_TX_FAILED, "tx failed"},
+	{DIAG_TLV_TX_RETRIES, "tx retries"},
+	{DIAG_TLV_QUEUE_HWM, "queue hwm"},
+	{DIAG_TLV_QUEUE_OVERFLOWS, "overflows"},
+	{DIAG_TLV_CONNECTS, "connects"},
+};
+
+static void print_remote_diag(const struct shell *sh, struct app_remote_proto_rx *rx)
+{
+	static uint8_t diag[SC_PROTO_STATS_MAX_SIZE];
+	uint32_t age_ms;
+	uint8_t len = app_remote_proto_diag_get(rx, diag, &age_ms);
+
+	if (!len) {
+		return;
+	}
+
+	shell_print(sh, "  As seen by the remote, %u ms ago:", age_ms);
+
+	for (uint16_t i = 0; (i + 2) <= len; i += 2 + diag[i + 1]) {
+		uint8_t type = diag[i];
+		uint8_t size = diag[i + 1];
+		const uint8_t *value = &diag[i + 2];
+
+		if ((i + 2 + size) > len) {
+			break;
+		}
+
+		if ((type == DIAG_TLV_RSSI) && (size == 1)) {
+			shell_print(sh, "    %-12s %d dBm", "rssi", (int8_t)value[0]);
+			continue;
+		}
+
+		for (int j = 0; j < ARRAY_SIZE(m_remote_counters); j++) {
+			if ((m_remote_counters[j].type == type) && (size == sizeof(uint32_t))) {
+				shell_print(sh, "    %-12s %u", m_remote_counters[j].name,
+					    sys_get_le32(value));
+			}
+		}
+	}
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_usb_hid_stats hid;
+
+	app_usb_hid_stats_get(&hid);
+
+	shell_print(sh, "HID: %u direct, %u queued, %u coalesced, %u dropped",
+		    hid.direct, hid.queued, hid.coalesced, hid.dropped);
+	shell_print(sh, "HID endpoint: %u busy, %u timeouts, %u write errors",
+		    hid.ep_busy, hid.ep_timeouts, hid.write_errors);
+	shell_print(sh, "HID queue: %u pending, high watermark %u of %u",
+		    hid.pending, hid.queue_hwm, CONFIG_SC_DONGLE_HID_QUEUE_DEPTH);
+	shell_print(sh, "Remote connections since boot: %u", app_ble_nus_c_connect_count());
+
+	for (uint8_t i = 0; i < m_remote_count; i++) {
+		const struct app_remote_proto_stats *stats = &m_remote_rx[i].stats;
+
+		if (!app_ble_nus_c_connected(i)) {
+			continue;
+		}
+
+		shell_print(sh, "Remote %u: %u frames, %u events, %u lost, %u resyncs, %u malformed",
+			    i, stats->frames, stats->events, stats->lost_frames,
+			    stats->resyncs, stats->malformed);
+		print_remote_diag(sh, &m_remote_rx[i]);
+	}
+	return 0;
+}
+
+static int cmd_conn(const struct shell *sh, size_t argc, char **argv)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+	struct bt_conn_info info;
+	bool any = false;
+
+	for (uint8_t i = 0; i < m_remote_count; i++) {
+		struct bt_conn *conn = app_ble_nus_c_conn_get(i);
+
+		if (!conn) {
+			continue;
+		}
+
+		if (bt_conn_get_info(conn, &info)) {
+			bt_conn_unref(conn);
+			continue;
+		}
+
+		any = true;
+		bt_addr_le_to_str(info.le.dst, addr, sizeof(addr));
+		shell_print(sh, "Remote %u: %s, interval %u.%02u ms, latency %u, timeout %u ms, security %u",
+			    i, addr, (info.le.interval * 125) / 100, (info.le.interval * 125) % 100,
+			    info.le.latency, info.le.timeout * 10, bt_conn_get_security(conn));
+
+#if defined(CONFIG_SC_LINK_SETUP)
+		struct link_setup_info link;
+
+		if (!link_setup_info_get(conn, &link)) {
+			shell_print(sh, "  PHY tx %u rx %u, data length tx %u rx %u, MTU %u",
+				    link.tx_phy, link.rx_phy, link.tx_len, link.rx_len, link.mtu);
+		}
+#endif
+		bt_conn_unref(conn);
+	}
+
+	if (!any) {
+		shell_print(sh, "No remote connected");
+	}
+	return 0;
+}
+
+#if defined(CONFIG_SC_DONGLE_LATENCY_STATS)
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv)
+{
+	if ((argc > 1) && !strcmp(argv[1], "reset")) {
+		app_latency_reset();
+		return 0;
+	}
+
+	for (int i = 0; i < APP_LATENCY_STAGE_COUNT; i++) {
+		static struct latency_hist hist;
+
+		app_latency_hist_get(i, &hist);
+		shell_print(sh, "%-6s n=%u p50=%u p99=%u max=%u mean=%u us",
+			    app_latency_stage_name(i), hist.count,
+			    latency_hist_percentile(&hist, 50), latency_hist_percentile(&hist, 99),
+			    hist.max, latency_hist_mean(&hist));
+	}
+
+	// Goes to the log, which the shell shows as well
+	app_usb_sof_dump();
+	return 0;
+}
+#endif
+
+#if defined(CONFIG_THREAD_MONITOR)
+struct thread_dump {
+	const struct shell *sh;
+	uint64_t total;
+	// First pass adds up the run time, the second one prints
+	bool print;
+};
+
+static struct {
+	const struct k_thread *thread;
+	uint64_t cycles;
+} m_thread_cycles[THREADS_MAX];
+
+// Run time since the previous call, and remember the current one
+static uint64_t thread_cycles_delta(const struct k_thread *thread, bool update)
+{
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+	k_thread_runtime_stats_t rt;
+	int free_slot = -1;
+
+	if (k_thread_runtime_stats_get((k_tid_t)thread, &rt)) {
+		return 0;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(m_thread_cycles); i++) {
+		if (m_thread_cycles[i].thread == thread) {
+			uint64_t delta = rt.execution_cycles - m_thread_cycles[i].cycles;
+
+			if (update) {
+				m_thread_cycles[i].cycles = rt.execution_cycles;
+			}
+			return delta;
+		}
+		if ((free_slot < 0) && !m_thread_cycles[i].thread) {
+			free_slot = i;
+		}
+	}
+
+	if (update && (free_slot >= 0)) {
+		m_thread_cycles[free_slot].thread = thread;
+		m_thread_cycles[free_slot].cycles = rt.execution_cycles;
+	}
+	return rt.execution_cycles;
+#else
+	return 0;
+#endif
+}
+
+static void thread_dump(const struct k_thread *thread, void *user_data)
+{
+	struct thread_dump *dump = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	uint64_t cycles = thread_cycles_delta(thread, dump->print);
+	uint32_t permille = dump->total ? (uint32_t)((cycles * 1000) / dump->total) : 0;
+	size_t size = 0, unused = 0;
+
+	if (!dump->print) {
+		dump->total += cycles;
+		return;
+	}
+
+#if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
+	size = thread->stack_info.size;
+	if (k_thread_stack_space_get(thread, &unused)) {
+		unused = size;
+	}
+#endif
+
+	shell_print(dump->sh, "%-20s %4d %4u.%u %6u/%-6u", name ? name : "?",
+		    thread->base.prio, permille / 10, permille % 10, (uint32_t)(size - unused), (uint32_t)size);
+}
+
+static int cmd_threads(const struct shell *sh, size_t argc, char **argv)
+{
+	struct thread_dump dump = {.sh = sh};
+
+	k_thread_foreach_unlocked(thread_dump, &dump);
+	dump.print = true;
+	shell_print(sh, "%-20s %4s %6s %13s", "thread", "prio", "cpu %", "stack used");
+	k_thread_foreach_unlocked(thread_dump, &dump);
+	return 0;
+}
+#endif
+
+#if defined(CONFIG_SC_DONGLE_TRACE)
+static int cmd_trace(const struct shell *sh, size_t argc, char **argv)
+{
+	struct app_trace_stats stats;
+	int err = 0;
+
+	if (argc > 1) {
+		if (!strcmp(argv[1], "on")) {
+			err = app_trace_enable(true);
+		} else if (!strcmp(argv[1], "off")) {
+			err = app_trace_enable(false);
+		} else {
+			shell_help(sh);
+			return -EINVAL;
+		}
+	}
+
+	if (err) {
+		shell_error(sh, "Trace port not available (err %d)", err);
+		return err;
+	}
+
+	app_trace_stats_get(&stats);
+	shell_print(sh, "Trace %s, %u records, %u dropped", stats.enabled ? "on" : "off",
+		    stats.records, stats.dropped);
+	return 0;
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sc_cmds,
+	SHELL_CMD(stats, NULL, "HID, queue and remote decoder counters", cmd_stats),
+	SHELL_CMD(conn, NULL, "Connected remotes and their link parameters", cmd_conn),
+#if defined(CONFIG_SC_DONGLE_LATENCY_STATS)
+	SHELL_CMD_ARG(latency, NULL, "Latency histograms [reset]", cmd_latency, 1, 1),
+#endif
+#if defined(CONFIG_THREAD_MONITOR)
+	SHELL_CMD(threads, NULL, "CPU use since the last call, and stack use per thread",
+		  cmd_threads),
+#endif
+#if defined(CONFIG_SC_DONGLE_TRACE)
+	SHELL_CMD_ARG(trace, NULL, "Binary event trace on the second port [on|off]",
+		      cmd_trace, 1, 1),
+#endif
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(sc, &sc_cmds, "Shortcut dongle diagnostics", NULL);
@@ -0,0 +1,118 @@
+#include "app_trace.h"
+
+#include <device.h>
+#include <drivers/uart.h>
+#include <sys/byteorder.h>
+#include <sys/ring_buffer.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_trace, CONFIG_SC_LOG_LEVEL);
+
+// Bytes handed to the UART FIFO per TX interrupt
+#define TX_CHUNK	64
+
+static const struct device *m_uart;
+static bool m_enabled;
+static atomic_t m_records;
+static atomic_t m_dropped;
+
+// Written from every context that traces, drained by the UART TX interrupt
+RING_BUF_DECLARE(m_ring, CONFIG_SC_DONGLE_TRACE_BUF_SIZE);
+static struct k_spinlock m_lock;
+
+static void uart_isr(const struct device *dev, void *user_data)
+{
+	uint8_t *data;
+	uint32_t len;
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		if (!uart_irq_tx_ready(dev)) {
+			continue;
+		}
+
+		len = ring_buf_get_claim(&m_ring, &data, TX_CHUNK);
+		if (len == 0) {
+			uart_irq_tx_disable(dev);
+			break;
+		}
+
+		len = uart_fifo_fill(dev, data, len);
+		ring_buf_get_finish(&m_ring, len);
+	}
+}
+
+static void trace_put(uint8_t type, uint8_t arg8, uint16_t arg16, uint32_t cycles)
+{
+	struct app_trace_record record = {
+		.type = type,
+		.arg8 = arg8,
+		.arg16 = sys_cpu_to_le16(arg16),
+		.cycles = sys_cpu_to_le32(cycles),
+	};
+	k_spinlock_key_t key;
+	bool stored;
+
+	// Whole records only, so the host never has to resync
+	key = k_spin_lock(&m_lock);
+	stored = ring_buf_space_get(&m_ring) >= sizeof(record);
+	if (stored) {
+		ring_buf_put(&m_ring, (uint8_t *)&record, sizeof(record));
+	}
+	k_spin_unlock(&m_lock, key);
+
+	if (!stored) {
+		atomic_inc(&m_dropped);
+		return;
+	}
+
+	atomic_inc(&m_records);
+	uart_irq_tx_enable(m_uart);
+}
+
+void app_trace_event(enum app_trace_type type, uint8_t arg8, uint16_t arg16)
+{
+	if (m_enabled) {
+		trace_put(type, arg8, arg16, k_cycle_get_32());
+	}
+}
+
+int app_trace_enable(bool enable)
+{
+	if (!m_uart) {
+		return -ENODEV;
+	}
+
+	if (enable && !m_enabled) {
+		// Tells the host the rate of the timestamps in the records that follow
+		trace_put(APP_TRACE_START, 0, sizeof(struct app_trace_record),
+			  sys_clock_hw_cycles_per_sec());
+		m_enabled = true;
+	} else if (!enable) {
+		m_enabled = false;
+	}
+	return 0;
+}
+
+void app_trace_stats_get(struct app_trace_stats *stats)
+{
+	stats->records = atomic_get(&m_records);
+	stats->dropped = atomic_get(&m_dropped);
+	stats->enabled = m_enabled;
+}
+
+static int app_trace_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	m_uart = device_get_binding(CONFIG_SC_DONGLE_TRACE_UART_NAME);
+	if (!m_uart) {
+		LOG_ERR("Trace UART %s not found", CONFIG_SC_DONGLE_TRACE_UART_NAME);
+		return -ENODEV;
+	}
+
+	uart_irq_callback_set(m_uart, uart_isr);
+	return 0;
+}
+
+SYS_INIT(app_trace_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -1,168 +1,410 @@
 #include "app_usb_hid.h"
+#include "app_latency.h"
+#include "app_hid_capture.h"
+#include "app_usb_sof.h"
+#include "app_trace.h"
+
+#include <sc_hid.h>
 
 #include <init.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <sys/math_extras.h>
 
 #include <usb/usb_device.h>
 #include <usb/class/usb_hid.h>
 
 #include <logging/log.h>
 
-#define LOG_LEVEL LOG_LEVEL_INF
-LOG_MODULE_REGISTER(app_usb_hid);
-
-#define HID_KBD_USAGE_CONS_CTRL_POWER				0x09, 0x30
-#define HID_KBD_USAGE_CONS_CTRL_RESET				0x09, 0x31
-#define HID_KBD_USAGE_CONS_CTRL_SLEEP				0x09, 0x32
-#define HID_KBD_USAGE_CONS_CTRL_SCAN_NEXT_TRACK 	0x09, 0xB5
-#define HID_KBD_USAGE_CONS_CTRL_SCAN_PREV_TRACK 	0x09, 0xB6
-#define HID_KBD_USAGE_CONS_CTRL_PLAY_PAUSE 			0x09, 0xCD
-#define HID_KBD_USAGE_CONS_CTRL_MUTE	 			0x09, 0xE2
-#define HID_KBD_USAGE_CONS_CTRL_VOLUME_UP			0x09, 0xE9
-#define HID_KBD_USAGE_CONS_CTRL_VOLUME_DOWN 		0x09, 0xEA
-#define HID_KBD_USAGE_CONS_CTRL_AC_BACK				0x0A, 0x24, 0x02,  
-#define HID_KBD_USAGE_CONS_CTRL_AC_FORWARD			0x0A, 0x25, 0x02,  
+LOG_MODULE_REGISTER(app_usb_hid, CONFIG_SC_LOG_LEVEL);
 
 static bool configured;
-static const struct device *hdev;
-static ATOMIC_DEFINE(hid_ep_in_busy, 1);
+// Signalled whenever an interface is done with a report
+static K_SEM_DEFINE(hid_tx_done, 0, 1);
 
 #define HID_EP_BUSY_FLAG		0
 
-#define REPORT_ID_KBD			0x01
-#define REPORT_ID_CONS_CTRL		0x02
-#define REPORT_SIZE_KBD			9
-#define REPORT_SIZE_CONS_CTRL	2
+#define HID_EP_IN_TIMEOUT		K_MSEC(CONFIG_SC_DONGLE_HID_EP_TIMEOUT_MS)
+#define HID_WRITE_RETRIES		3
+#define HID_WRITE_RETRY_DELAY	K_MSEC(1)
+
+#define REPORT_ID_KBD			SC_HID_REPORT_ID_KBD
+#define REPORT_ID_CONS_CTRL		SC_HID_REPORT_ID_CONS_CTRL
+#define KBD_ROLLOVER			SC_HID_KBD_ROLLOVER
+#define KBD_ERROR_ROLLOVER		0x01
+#if defined(CONFIG_SC_DONGLE_KBD_NKRO)
+// One bit per usage from 0x00 up to and including NKRO_USAGE_MAX
+#define NKRO_USAGE_MAX			0x67
+#define NKRO_BITMAP_SIZE		((NKRO_USAGE_MAX + 8) / 8)
+#define REPORT_SIZE_KBD			(2 + NKRO_BITMAP_SIZE)
+#else
+#define REPORT_SIZE_KBD			(1 + SC_HID_KBD_REPORT_SIZE)
+#endif
+#define REPORT_SIZE_CONS_CTRL	(1 + SC_HID_CONS_CTRL_REPORT_SIZE)
+#define REPORT_ID_COUNT			2
 
 #define REPORT_PERIOD		K_SECONDS(2)
 
+// The keyboard and the consumer control reports each have their own HID
+// interface, IN endpoint and queue, so media keys never wait behind typing
+enum hid_iface_id {
+	IFACE_KBD,
+	IFACE_CONS_CTRL,
+	IFACE_COUNT
+};
+
+struct hid_iface {
+	const char *name;
+	uint8_t report_id;
+	const uint8_t *report_desc;
+	size_t report_desc_size;
+	const struct device *dev;
+	atomic_t ep_busy;
+	struct k_sem *ep_ready;
+	// Reports queued but not yet handed to the endpoint
+	atomic_t in_flight;
+	// Reports waiting for the endpoint, only used when it is busy
+	struct k_msgq *queue;
+	struct app_latency_tag ep_tag;
+};
+
 struct report {
 	uint8_t report_id;
 	union {
+#if defined(CONFIG_SC_DONGLE_KBD_NKRO)
+		struct {
+			uint8_t flags;
+			uint8_t bitmap[NKRO_BITMAP_SIZE];
+		} kbd;
+#else
 		struct {
 			uint8_t flags;
 			uint8_t padding;
-			uint8_t keys[6];
+			uint8_t keys[KBD_ROLLOVER];
 		} kbd;
+#endif
 		struct {
-			uint8_t button_bitfield;
+			// Little endian usages, kept as bytes so the report stays packed
+			uint8_t usages[SC_HID_CONS_CTRL_REPORT_SIZE];
 		} cons_ctrl;
 	} data;
+	// Not sent to the host, the report size is given by the report ID
+	struct app_latency_tag tag;
 };
 
-// Create a message queue for holding HID packets. 
-K_MSGQ_DEFINE(m_hid_msg_queue, sizeof(struct report), 10, 4);
-
-static const uint8_t hid_report_desc[] = {
-		0x05, 0x01,       /* Usage Page (Generic Desktop) */
-		0x09, 0x06,       /* Usage (Keyboard) */
-		0xA1, 0x01,       /* Collection (Application) */
-
-		0x85, REPORT_ID_KBD, /* Report ID 1 */
-		/* Keys */
-		0x05, 0x07,       /* Usage Page (Key Codes) */
-		0x19, 0xe0,       /* Usage Minimum (224) */
-		0x29, 0xe7,       /* Usage Maximum (231) */
-		0x15, 0x00,       /* Logical Minimum (0) */
-		0x25, 0x01,       /* Logical Maximum (1) */
+// Reports are built in a slab buffer and handed around by pointer. For each
+// interface, one buffer more than its queue holds for the TX thread, one for
+// the caller.
+K_MEM_SLAB_DEFINE(m_report_slab, sizeof(struct report),
+		  IFACE_COUNT * (CONFIG_SC_DONGLE_HID_QUEUE_DEPTH + 2), 4);
+
+K_MSGQ_DEFINE(m_kbd_queue, sizeof(struct report *), CONFIG_SC_DONGLE_HID_QUEUE_DEPTH, 4);
+K_MSGQ_DEFINE(m_cons_ctrl_queue, sizeof(struct report *), CONFIG_SC_DONGLE_HID_QUEUE_DEPTH, 4);
+static K_SEM_DEFINE(m_kbd_ep_ready, 0, 1);
+static K_SEM_DEFINE(m_cons_ctrl_ep_ready, 0, 1);
+
+// Last report of each report ID accepted by the endpoint
+static struct report last_sent[REPORT_ID_COUNT];
+
+static struct {
+	atomic_t direct;
+	atomic_t queued;
+	atomic_t coalesced;
+	atomic_t dropped;
+	atomic_t ep_timeouts;
+	atomic_t write_errors;
+	atomic_t ep_busy;
+	atomic_t queue_hwm;
+} hid_stats;
+
+static const uint8_t kbd_report_desc[] = {
+		SC_HID_REPORT_DESC_KBD_START,
+
+#if defined(CONFIG_SC_DONGLE_KBD_NKRO)
+		0x95, NKRO_USAGE_MAX + 1, /* Report Count (104) */
 		0x75, 0x01,       /* Report Size (1) */
-		0x95, 0x08,       /* Report Count (8) */
-		0x81, 0x02,       /* Input (Data, Variable, Absolute) */
-
-		0x95, 0x01,       /* Report Count (1) */
-		0x75, 0x08,       /* Report Size (8) */
-		0x81, 0x01,       /* Input (Constant) reserved byte(1) */
-
-		0x95, 0x06,       /* Report Count (6) */
-		0x75, 0x08,       /* Report Size (8) */
 		0x15, 0x00,       /* Logical Minimum (0) */
-		0x25, 0x65,       /* Logical Maximum (101) */
+		0x25, 0x01,       /* Logical Maximum (1) */
 		0x05, 0x07,       /* Usage Page (Key codes) */
 		0x19, 0x00,       /* Usage Minimum (0) */
-		0x29, 0x65,       /* Usage Maximum (101) */
-		0x81, 0x00,       /* Input (Data, Array) Key array(6 bytes) */
-
-		0xC0,             /* End Collection (Application) */
-
-		        // Report ID 2: Advanced buttons (consumer control)
-        0x05, 0x0C,                     // Usage Page (Consumer)
-        0x09, 0x01,                     // Usage (Consumer Control)
-        0xA1, 0x01,                     // Collection (Application)
-        0x85, REPORT_ID_CONS_CTRL,      //     Report Id (2)
-        0x15, 0x00,                     //     Logical minimum (0)
-        0x25, 0x01,                     //     Logical maximum (1)
-        0x75, 0x01,                     //     Report Size (1)
-        0x95, 0x01,                     //     Report Count (1)
-
-        HID_KBD_USAGE_CONS_CTRL_VOLUME_UP,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        HID_KBD_USAGE_CONS_CTRL_VOLUME_DOWN,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        HID_KBD_USAGE_CONS_CTRL_PLAY_PAUSE,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        HID_KBD_USAGE_CONS_CTRL_MUTE,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-
-        HID_KBD_USAGE_CONS_CTRL_SCAN_NEXT_TRACK,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        HID_KBD_USAGE_CONS_CTRL_SCAN_PREV_TRACK,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        HID_KBD_USAGE_CONS_CTRL_POWER,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        HID_KBD_USAGE_CONS_CTRL_SLEEP,
-        0x81, 0x02,                     //     Input (Data,Value,Relative,Bit Field)
-        0xC0                            // End Collection
+		0x29, NKRO_USAGE_MAX, /* Usage Maximum (103) */
+		0x81, 0x02,       /* Input (Data, Variable, Absolute) Key bitmap */
+#else
+		SC_HID_REPORT_DESC_KBD_KEYS,
+#endif
+
+		SC_HID_REPORT_DESC_KBD_END
+};
+
+// Report ID 2: Advanced buttons (consumer control)
+static const uint8_t cons_ctrl_report_desc[] = {
+		SC_HID_REPORT_DESC_CONS_CTRL
+};
+
+static struct hid_iface m_ifaces[IFACE_COUNT] = {
+	[IFACE_KBD] = {
+		.name = "HID_0",
+		.report_id = REPORT_ID_KBD,
+		.report_desc = kbd_report_desc,
+		.report_desc_size = sizeof(kbd_report_desc),
+		.ep_ready = &m_kbd_ep_ready,
+		.queue = &m_kbd_queue,
+	},
+	[IFACE_CONS_CTRL] = {
+		.name = "HID_1",
+		.report_id = REPORT_ID_CONS_CTRL,
+		.report_desc = cons_ctrl_report_desc,
+		.report_desc_size = sizeof(cons_ctrl_report_desc),
+		.ep_ready = &m_cons_ctrl_ep_ready,
+		.queue = &m_cons_ctrl_queue,
+	},
 };
 
-static void send_report(struct report *hid_report)
+static struct hid_iface *report_iface(uint8_t report_id)
 {
-	int ret, wrote;
-	uint32_t size;
+	return &m_ifaces[(report_id == REPORT_ID_CONS_CTRL) ? IFACE_CONS_CTRL : IFACE_KBD];
+}
+
+static inline uint8_t iface_index(const struct hid_iface *iface)
+{
+	return iface - m_ifaces;
+}
 
-	// Set the size of the report according to the report ID
-	switch(hid_report->report_id) {
+static uint32_t report_size(uint8_t report_id)
+{
+	switch(report_id) {
 		case REPORT_ID_KBD:
-			size = REPORT_SIZE_KBD;
-			break;
+			return REPORT_SIZE_KBD;
 		case REPORT_ID_CONS_CTRL:
-			size = REPORT_SIZE_CONS_CTRL;
-			break;
+			return REPORT_SIZE_CONS_CTRL;
 		default:
-			return;
+			return 0;
 	}
+}
 
-	// Send the packet over the HID endpoint, assuming it is not busy
-	if (!atomic_test_and_set_bit(hid_ep_in_busy, HID_EP_BUSY_FLAG)) {
-		ret = hid_int_ep_write(hdev, (uint8_t *)hid_report, size, &wrote);
-		if (ret != 0) {
-			/*
-			 * Do nothing and wait until host has reset the device
-			 * and hid_ep_in_busy is cleared.
-			 */
-			LOG_ERR("Failed to submit report");
-		} else {
+// Keyboard report as a bitmap of usages, modifiers included (0xE0 - 0xE7)
+static void kbd_report_to_bitmap(const struct report *hid_report,
+				 uint32_t bitmap[APP_USB_HID_KEY_BITMAP_WORDS])
+{
+	memset(bitmap, 0, APP_USB_HID_KEY_BITMAP_WORDS * sizeof(uint32_t));
+#if defined(CONFIG_SC_DONGLE_KBD_NKRO)
+	memcpy(bitmap, hid_report->data.kbd.bitmap, NKRO_BITMAP_SIZE);
+#else
+	for (int i = 0; i < ARRAY_SIZE(hid_report->data.kbd.keys); i++) {
+		uint8_t key = hid_report->data.kbd.keys[i];
+		if (key) {
+			bitmap[key / 32] |= BIT(key % 32);
+		}
+	}
+#endif
+	bitmap[0xE0 / 32] |= (uint32_t)hid_report->data.kbd.flags << (0xE0 % 32);
+}
+
+static bool cons_ctrl_report_holds(const struct report *hid_report, uint16_t usage)
+{
+	for (int i = 0; i < SC_HID_CONS_CTRL_SLOTS; i++) {
+		if (sys_get_le16(&hid_report->data.cons_ctrl.usages[2 * i]) == usage) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * A pending report may be replaced by a newer one of the same ID only if no
+ * usage changes state twice on the way, otherwise a press or a release that
+ * the host never saw would be lost.
+ */
+static bool report_can_coalesce(const struct report *pending, const struct report *next)
+{
+	const struct report *sent = &last_sent[pending->report_id - 1];
+
+	if (next->report_id != pending->report_id) {
+		return false;
+	}
+
+	switch(pending->report_id) {
+		case REPORT_ID_KBD: {
+			uint32_t a[APP_USB_HID_KEY_BITMAP_WORDS];
+			uint32_t b[APP_USB_HID_KEY_BITMAP_WORDS];
+			uint32_t c[APP_USB_HID_KEY_BITMAP_WORDS];
+
+			kbd_report_to_bitmap(sent, a);
+			kbd_report_to_bitmap(pending, b);
+			kbd_report_to_bitmap(next, c);
+			for (int i = 0; i < ARRAY_SIZE(a); i++) {
+				if ((a[i] ^ b[i]) & (b[i] ^ c[i])) {
+					return false;
+				}
+			}
+			return true;
+		}
+		case REPORT_ID_CONS_CTRL:
+			// Only the usages in the pending report or the next one can change twice
+			for (int i = 0; i < SC_HID_CONS_CTRL_SLOTS; i++) {
+				const struct report *reports[] = {pending, next};
+
+				for (int j = 0; j < ARRAY_SIZE(reports); j++) {
+					uint16_t usage = sys_get_le16(
+						&reports[j]->data.cons_ctrl.usages[2 * i]);
+					bool a, b, c;
+
+					if (!usage) {
+						continue;
+					}
+					a = cons_ctrl_report_holds(sent, usage);
+					b = cons_ctrl_report_holds(pending, usage);
+					c = cons_ctrl_report_holds(next, usage);
+					if ((a != b) && (b != c)) {
+						return false;
+					}
+				}
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Wait until the IN endpoint of the interface is free, and claim it
+static void hid_ep_in_acquire(struct hid_iface *iface)
+{
+	if (atomic_test_bit(&iface->ep_busy, HID_EP_BUSY_FLAG)) {
+		atomic_inc(&hid_stats.ep_busy);
+	}
+
+	while (atomic_test_and_set_bit(&iface->ep_busy, HID_EP_BUSY_FLAG)) {
+		if ((k_sem_take(iface->ep_ready, HID_EP_IN_TIMEOUT) != 0) && configured) {
+			// The transfer never completed. Don't wait for the host to reset us.
+			LOG_WRN("%s IN endpoint timeout", iface->name);
+			atomic_inc(&hid_stats.ep_timeouts);
+			atomic_clear_bit(&iface->ep_busy, HID_EP_BUSY_FLAG);
+			k_sem_give(&hid_tx_done);
+		}
+	}
+}
+
+// Send a report over its HID interface. The endpoint must have been acquired.
+// On failure the endpoint is released again.
+static int send_report(struct hid_iface *iface, struct report *hid_report, int retries)
+{
+	int ret, wrote;
+	uint32_t size = report_size(hid_report->report_id);
+
+	if (size == 0) {
+		atomic_clear_bit(&iface->ep_busy, HID_EP_BUSY_FLAG);
+		return -EINVAL;
+	}
+
+	for (int attempt = 0; ; attempt++) {
+		app_latency_submitted(&hid_report->tag);
+		// The poll timing is learned from the keyboard endpoint only
+		if (iface == &m_ifaces[IFACE_KBD]) {
+			app_usb_sof_submitted();
+		}
+		iface->ep_tag = hid_report->tag;
+#if defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+		ret = app_hid_capture_write(iface_index(iface), (uint8_t *)hid_report, size, &wrote);
+#else
+		ret = hid_int_ep_write(iface->dev, (uint8_t *)hid_report, size, &wrote);
+#endif
+		if (ret == 0) {
+			last_sent[hid_report->report_id - 1] = *hid_report;
+			app_trace_event(APP_TRACE_REPORT_SUBMITTED, hid_report->report_id, 0);
 			LOG_DBG("Report submitted");
+			return 0;
 		}
-	} else {
-		LOG_DBG("HID IN endpoint busy");
+
+		atomic_inc(&hid_stats.write_errors);
+		if (attempt >= retries) {
+			atomic_clear_bit(&iface->ep_busy, HID_EP_BUSY_FLAG);
+			k_sem_give(&hid_tx_done);
+			return ret;
+		}
+
+		k_sleep(HID_WRITE_RETRY_DELAY);
+	}
+}
+
+static void iface_in_ready(struct hid_iface *iface)
+{
+	app_latency_completed(&iface->ep_tag);
+	if (iface == &m_ifaces[IFACE_KBD]) {
+		app_usb_sof_completed();
+	}
+	app_trace_event(APP_TRACE_REPORT_DONE, iface_index(iface), 0);
+	if (!atomic_test_and_clear_bit(&iface->ep_busy, HID_EP_BUSY_FLAG)) {
+		LOG_WRN("%s IN endpoint callback without preceding buffer write", iface->name);
 	}
+	k_sem_give(iface->ep_ready);
+	k_sem_give(&hid_tx_done);
 }
 
 static void int_in_ready_cb(const struct device *dev)
 {
-	ARG_UNUSED(dev);
-	if (!atomic_test_and_clear_bit(hid_ep_in_busy, HID_EP_BUSY_FLAG)) {
-		LOG_WRN("IN endpoint callback without preceding buffer write");
+	for (int i = 0; i < IFACE_COUNT; i++) {
+		if (m_ifaces[i].dev == dev) {
+			iface_in_ready(&m_ifaces[i]);
+			return;
+		}
+	}
+}
+
+#if defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+static void capture_in_ready_cb(uint8_t ep)
+{
+	iface_in_ready(&m_ifaces[ep]);
+}
+#endif
+
+static app_usb_hid_idle_handler_t m_idle_handler;
+// Interfaces whose idle period ran out, one bit each
+static atomic_t m_idle_pending;
+
+static void idle_work_handler(struct k_work *work)
+{
+	for (int i = 0; i < IFACE_COUNT; i++) {
+		if (!atomic_test_and_clear_bit(&m_idle_pending, i)) {
+			continue;
+		}
+
+		// A report on its way already tells the host the current state
+		if (atomic_get(&m_ifaces[i].in_flight)) {
+			continue;
+		}
+
+		m_idle_handler(m_ifaces[i].report_id);
 	}
 }
 
+static K_WORK_DEFINE(m_idle_work, idle_work_handler);
+
 /*
- * On Idle callback is available here as an example even if actual use is
- * very limited. In contrast to report_event_handler(),
- * report value is not incremented here.
+ * Called from the SOF interrupt when the idle period set by the host with
+ * SET_IDLE runs out. The report ID given is the index of the stack's idle
+ * timer, with CONFIG_USB_HID_REPORTS=1 it is always the same, so the
+ * interface tells which report is due.
  */
 static void on_idle_cb(const struct device *dev, uint16_t report_id)
 {
-	LOG_DBG("On idle callback");
+	ARG_UNUSED(report_id);
+
+	if (!m_idle_handler) {
+		return;
+	}
+
+	for (int i = 0; i < IFACE_COUNT; i++) {
+		if (m_ifaces[i].dev == dev) {
+			atomic_set_bit(&m_idle_pending, i);
+			k_work_submit(&m_idle_work);
+			return;
+		}
+	}
+}
+
+void app_usb_hid_idle_handler_set(app_usb_hid_idle_handler_t handler)
+{
+	m_idle_handler = handler;
 }
 
 static void protocol_cb(const struct device *dev, uint8_t protocol)
@@ -185,11 +427,14 @@ static void status_cb(enum usb_dc_status_code status, const uint8_t *param)
 		break;
 	case USB_DC_CONFIGURED:
 		if (!configured) {
-			int_in_ready_cb(hdev);
+			for (int i = 0; i < IFACE_COUNT; i++) {
+				iface_in_ready(&m_ifaces[i]);
+			}
 			configured = true;
 		}
 		break;
 	case USB_DC_SOF:
+		app_usb_sof_event();
 		break;
 	default:
 		LOG_DBG("status %u unhandled", status);
@@ -197,17 +442,111 @@ static void status_cb(enum usb_dc_status_code status, const uint8_t *param)
 	}
 }
 
-// HID TX thread function. Used to send HID packets over USB. 
-void usb_hid_tx_func(void)
+// HID TX thread function, one per interface. Sends the reports that were queued while
+// the interface's endpoint was busy.
+void usb_hid_tx_func(void *p1, void *p2, void *p3)
 {
-	static struct report new_report;
+	struct hid_iface *iface = p1;
+	struct report *new_report, *next_report;
+
 	while(1) {
-		// Wait until there is a new message in the queue, and read it out
-		k_msgq_get(&m_hid_msg_queue, &new_report, K_FOREVER);
+		// Wait until there is a new report in the queue, and take it out
+		k_msgq_get(iface->queue, &new_report, K_FOREVER);
+
+		// Hold on to the report until the endpoint is free, rather than dropping it
+		hid_ep_in_acquire(iface);
+
+		// Hold back until just before the host polls, to send the freshest state
+		app_usb_sof_align();
+
+		// Reports queued up in the meantime may supersede this one
+		while ((k_msgq_peek(iface->queue, &next_report) == 0) &&
+		       report_can_coalesce(new_report, next_report)) {
+			k_msgq_get(iface->queue, &next_report, K_NO_WAIT);
+			// Keep the oldest timestamps, that is the event waiting the longest
+			next_report->tag = new_report->tag;
+			k_mem_slab_free(&m_report_slab, (void **)&new_report);
+			new_report = next_report;
+			atomic_inc(&hid_stats.coalesced);
+			atomic_dec(&iface->in_flight);
+		}
 
 		// Send the new report over the HID interface
-		send_report(&new_report);
+		if (send_report(iface, new_report, HID_WRITE_RETRIES)) {
+			LOG_ERR("Failed to submit report, dropped");
+			atomic_inc(&hid_stats.dropped);
+			app_trace_event(APP_TRACE_REPORT_DROPPED, new_report->report_id, 0);
+		}
+		k_mem_slab_free(&m_report_slab, (void **)&new_report);
+		atomic_dec(&iface->in_flight);
+	}
+}
+
+static struct report *report_alloc(uint8_t report_id)
+{
+	struct report *hid_report;
+
+	if (k_mem_slab_alloc(&m_report_slab, (void **)&hid_report, K_NO_WAIT)) {
+		LOG_WRN("Out of HID report buffers, report dropped");
+		atomic_inc(&hid_stats.dropped);
+		return NULL;
+	}
+
+	memset(hid_report, 0, sizeof(*hid_report));
+	hid_report->report_id = report_id;
+	return hid_report;
+}
+
+/*
+ * Takes ownership of the report. If nothing is queued on its interface and
+ * the endpoint is free, the report is written from the caller's context.
+ * Otherwise it is queued for the interface's TX thread, which keeps the
+ * reports in order.
+ */
+static int submit_report(uint8_t source, struct report *hid_report)
+{
+	struct hid_iface *iface = report_iface(hid_report->report_id);
+	int ret;
+
+	app_latency_tag_report(source, &hid_report->tag);
+
+	// Aligned to SOF, every report goes through the TX thread
+	if (!IS_ENABLED(CONFIG_SC_DONGLE_HID_SOF_ALIGN) &&
+	    atomic_cas(&iface->in_flight, 0, 1)) {
+		if (!atomic_test_and_set_bit(&iface->ep_busy, HID_EP_BUSY_FLAG)) {
+			ret = send_report(iface, hid_report, 0);
+			if (ret == 0) {
+				atomic_inc(&hid_stats.direct);
+				app_trace_event(APP_TRACE_REPORT_DIRECT, hid_report->report_id, 0);
+				k_mem_slab_free(&m_report_slab, (void **)&hid_report);
+				atomic_dec(&iface->in_flight);
+				return 0;
+			}
+			// Let the TX thread retry it
+		} else {
+			atomic_inc(&hid_stats.ep_busy);
+		}
+	} else {
+		atomic_inc(&iface->in_flight);
+	}
+
+	ret = k_msgq_put(iface->queue, &hid_report, K_NO_WAIT);
+	if (ret == 0) {
+		uint32_t used = k_msgq_num_used_get(iface->queue);
+
+		atomic_inc(&hid_stats.queued);
+		app_trace_event(APP_TRACE_REPORT_QUEUED, hid_report->report_id, used);
+		if (used > atomic_get(&hid_stats.queue_hwm)) {
+			atomic_set(&hid_stats.queue_hwm, used);
+		}
+	} else {
+		LOG_WRN("HID queue full, report dropped");
+		app_trace_event(APP_TRACE_REPORT_DROPPED, hid_report->report_id, 0);
+		k_mem_slab_free(&m_report_slab, (void **)&hid_report);
+		atomic_dec(&iface->in_flight);
+		atomic_inc(&hid_stats.dropped);
 	}
+	return ret;
 }
 
 int app_usb_hid_init(void)
@@ -216,7 +555,15 @@ int app_usb_hid_init(void)
 
 	LOG_INF("Initializing app_usb_hid");
 
+#if defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+	// No USB, a simulated host reads the reports
+	BUILD_ASSERT(IFACE_COUNT == APP_HID_CAPTURE_EP_COUNT);
+	app_hid_capture_init(capture_in_ready_cb);
+	configured = true;
+	ret = 0;
+#else
 	ret = usb_enable(status_cb);
+#endif
 	if (ret != 0) {
 		LOG_ERR("Failed to enable USB");
 		return ret;
@@ -225,49 +572,152 @@ int app_usb_hid_init(void)
 	return 0;
 }
 
+#if !defined(CONFIG_SC_DONGLE_HID_CAPTURE)
 static int composite_pre_init(const struct device *dev)
 {
-	hdev = device_get_binding("HID_0");
-	if (hdev == NULL) {
-		LOG_ERR("Cannot get USB HID Device");
-		return -ENODEV;
+	int ret;
+
+	for (int i = 0; i < IFACE_COUNT; i++) {
+		struct hid_iface *iface = &m_ifaces[i];
+
+		iface->dev = device_get_binding(iface->name);
+		if (iface->dev == NULL) {
+			LOG_ERR("Cannot get USB HID Device %s", iface->name);
+			return -ENODEV;
+		}
+
+		usb_hid_register_device(iface->dev, iface->report_desc,
+					iface->report_desc_size, &ops);
+
+		atomic_set_bit(&iface->ep_busy, HID_EP_BUSY_FLAG);
+
+		if (usb_hid_set_proto_code(iface->dev, HID_BOOT_IFACE_CODE_NONE)) {
+			LOG_WRN("Failed to set Protocol Code");
+		}
+
+		ret = usb_hid_init(iface->dev);
+		if (ret) {
+			return ret;
+		}
 	}
 
-	LOG_INF("HID Device: dev %p", hdev);
+	return 0;
+}
+#endif
 
-	usb_hid_register_device(hdev, hid_report_desc, sizeof(hid_report_desc),
-				&ops);
+int app_usb_hid_send_kbd_state(uint8_t source, uint8_t flags, const uint32_t *key_bitmap)
+{
+	struct report *kbd_report = report_alloc(REPORT_ID_KBD);
 
-	atomic_set_bit(hid_ep_in_busy, HID_EP_BUSY_FLAG);
+	if (!kbd_report) {
+		return -ENOMEM;
+	}
 
-	if (usb_hid_set_proto_code(hdev, HID_BOOT_IFACE_CODE_NONE)) {
-		LOG_WRN("Failed to set Protocol Code");
+	kbd_report->data.kbd.flags = flags;
+
+#if defined(CONFIG_SC_DONGLE_KBD_NKRO)
+	memcpy(kbd_report->data.kbd.bitmap, key_bitmap, NKRO_BITMAP_SIZE);
+	// Clear the bits past the last usage in the descriptor
+	kbd_report->data.kbd.bitmap[NKRO_BITMAP_SIZE - 1] &= BIT_MASK((NKRO_USAGE_MAX % 8) + 1);
+#else
+	int count = 0;
+
+	// Modifiers (0xE0 and up) are reported as flags, not in the key array
+	for (int word = 0; (word < (0xE0 / 32)) && (count <= KBD_ROLLOVER); word++) {
+		uint32_t bits = key_bitmap[word];
+
+		while (bits) {
+			uint8_t key = word * 32 + u32_count_trailing_zeros(bits);
+
+			bits &= bits - 1;
+			if (count == KBD_ROLLOVER) {
+				// More keys than the report can hold, as required by the HID spec
+				memset(kbd_report->data.kbd.keys, KBD_ERROR_ROLLOVER, KBD_ROLLOVER);
+				count++;
+				break;
+			}
+			kbd_report->data.kbd.keys[count++] = key;
+		}
 	}
+#endif
 
-	return usb_hid_init(hdev);
+	return submit_report(source, kbd_report);
 }
 
-int app_usb_hid_send_kbd_packet(uint8_t key1, uint8_t flags)
+int app_usb_hid_send_cons_ctrl_state(uint8_t source, const uint16_t *usages, uint8_t count)
 {
-	int ret;
-	static struct report kbd_report 
-		= {.report_id = REPORT_ID_KBD, .data.kbd.keys = {0,0,0,0,0,0}};
-	kbd_report.data.kbd.keys[0] = key1;
-	kbd_report.data.kbd.flags = flags;
-	ret = k_msgq_put(&m_hid_msg_queue, &kbd_report, K_NO_WAIT);
-	return ret;
+	struct report *cons_ctrl_report;
+
+	if (count > SC_HID_CONS_CTRL_SLOTS) {
+		return -EINVAL;
+	}
+
+	cons_ctrl_report = report_alloc(REPORT_ID_CONS_CTRL);
+	if (!cons_ctrl_report) {
+		return -ENOMEM;
+	}
+
+	for (int i = 0; i < count; i++) {
+		sys_put_le16(usages[i], &cons_ctrl_report->data.cons_ctrl.usages[2 * i]);
+	}
+	return submit_report(source, cons_ctrl_report);
 }
 
-int app_usb_hid_send_cons_ctrl_packet(uint8_t cons_ctrl_bitfield)
+// A queued report is counted until the endpoint has been claimed for it
+static bool ifaces_idle(void)
 {
-	int ret;
-	static struct report cons_ctrl_report = {.report_id = REPORT_ID_CONS_CTRL};
-	cons_ctrl_report.data.cons_ctrl.button_bitfield = cons_ctrl_bitfield;
-	ret = k_msgq_put(&m_hid_msg_queue, &cons_ctrl_report, K_NO_WAIT);
-	return ret;
+	for (int i = 0; i < IFACE_COUNT; i++) {
+		if (atomic_get(&m_ifaces[i].in_flight) ||
+		    atomic_test_bit(&m_ifaces[i].ep_busy, HID_EP_BUSY_FLAG)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int app_usb_hid_wait_idle(int32_t timeout_ms)
+{
+	int64_t deadline = k_uptime_get() + timeout_ms;
+	int64_t remaining;
+
+	while (1) {
+		k_sem_reset(&hid_tx_done);
+
+		if (ifaces_idle()) {
+			return 0;
+		}
+
+		remaining = deadline - k_uptime_get();
+		if (remaining <= 0) {
+			return -EAGAIN;
+		}
+		k_sem_take(&hid_tx_done, K_MSEC(remaining));
+	}
+}
+
+void app_usb_hid_stats_get(struct app_usb_hid_stats *stats)
+{
+	stats->direct = atomic_get(&hid_stats.direct);
+	stats->queued = atomic_get(&hid_stats.queued);
+	stats->coalesced = atomic_get(&hid_stats.coalesced);
+	stats->dropped = atomic_get(&hid_stats.dropped);
+	stats->ep_timeouts = atomic_get(&hid_stats.ep_timeouts);
+	stats->write_errors = atomic_get(&hid_stats.write_errors);
+	stats->ep_busy = atomic_get(&hid_stats.ep_busy);
+	stats->queue_hwm = atomic_get(&hid_stats.queue_hwm);
+	stats->pending = 0;
+	for (int i = 0; i < IFACE_COUNT; i++) {
+		stats->pending += atomic_get(&m_ifaces[i].in_flight);
+	}
 }
 
-// Create a thread for sending HID messages to the USB stack. 
-K_THREAD_DEFINE(m_thread_usb_hid_tx, 1024, usb_hid_tx_func, NULL, NULL, NULL, 5, 0, 0);
+// Create a thread per interface for sending HID messages to the USB stack. Media keys
+// are rare and short, let them preempt a long burst of typing.
+K_THREAD_DEFINE(m_thread_usb_hid_kbd_tx, 1024, usb_hid_tx_func, &m_ifaces[IFACE_KBD],
+		NULL, NULL, 5, 0, 0);
+K_THREAD_DEFINE(m_thread_usb_hid_cons_ctrl_tx, 1024, usb_hid_tx_func,
+		&m_ifaces[IFACE_CONS_CTRL], NULL, NULL, 4, 0, 0);
 
-SYS_INIT(composite_pre_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEVICE);
\ No newline at end of file
+#if !defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+SYS_INIT(composite_pre_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEVICE);
+#endif
\ No newline at end of file
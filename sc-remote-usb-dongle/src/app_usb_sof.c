@@ -0,0 +1,141 @@
+#include "app_usb_sof.h"
+
+#include <init.h>
+
+#include <latency_hist.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(app_usb_sof, CONFIG_SC_LOG_LEVEL);
+
+// Full speed frame
+#define FRAME_US			1000
+// A report submitted this soon after the previous completion was already
+// waiting for it, so the host read it on its very next poll
+#define BACK_TO_BACK_US		250
+// Completions between updates of the learned poll position
+#define PHASE_UPDATE_COUNT	64
+
+enum {
+	HIST_SOF_INTERVAL,
+	HIST_SOF_TO_IN,
+	HIST_POLL_INTERVAL,
+	HIST_COUNT
+};
+
+static const char *const hist_name[HIST_COUNT] = {
+	[HIST_SOF_INTERVAL] = "sof",
+	[HIST_SOF_TO_IN] = "sof-in",
+	[HIST_POLL_INTERVAL] = "poll",
+};
+
+// Each histogram has a single writer, SOF and completion events both come
+// from the USB driver's work queue
+static struct latency_hist m_hist[HIST_COUNT];
+
+static atomic_t m_last_sof;
+static atomic_t m_last_submit;
+static uint32_t m_last_complete;
+static uint32_t m_sof_count;
+static uint32_t m_complete_count;
+
+// Median time from SOF to the host reading the IN endpoint, 0 until known
+static atomic_t m_poll_phase_us;
+
+static inline uint32_t cyc_since_us(uint32_t start, uint32_t end)
+{
+	return k_cyc_to_us_floor32(end - start);
+}
+
+void app_usb_sof_event(void)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t prev = (uint32_t)atomic_set(&m_last_sof, now);
+
+	if (m_sof_count++) {
+		latency_hist_add(&m_hist[HIST_SOF_INTERVAL], cyc_since_us(prev, now));
+	}
+}
+
+void app_usb_sof_submitted(void)
+{
+	atomic_set(&m_last_submit, k_cycle_get_32());
+}
+
+void app_usb_sof_completed(void)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t submit = (uint32_t)atomic_get(&m_last_submit);
+
+	if (m_sof_count) {
+		latency_hist_add(&m_hist[HIST_SOF_TO_IN],
+				 cyc_since_us((uint32_t)atomic_get(&m_last_sof), now));
+	}
+
+	if (m_complete_count && ((int32_t)(submit - m_last_complete) >= 0) &&
+	    (cyc_since_us(m_last_complete, submit) < BACK_TO_BACK_US)) {
+		latency_hist_add(&m_hist[HIST_POLL_INTERVAL], cyc_since_us(m_last_complete, now));
+	}
+
+	m_last_complete = now;
+	if ((++m_complete_count % PHASE_UPDATE_COUNT) == 0) {
+		atomic_set(&m_poll_phase_us,
+			   latency_hist_percentile(&m_hist[HIST_SOF_TO_IN], 50));
+	}
+}
+
+#if defined(CONFIG_SC_DONGLE_HID_SOF_ALIGN)
+void app_usb_sof_align(void)
+{
+	int32_t target = (int32_t)atomic_get(&m_poll_phase_us) - CONFIG_SC_DONGLE_HID_SOF_GUARD_US;
+	uint32_t since_sof = cyc_since_us((uint32_t)atomic_get(&m_last_sof), k_cycle_get_32());
+
+	// Not learned yet, or no SOFs because the bus is suspended
+	if ((target <= 0) || (since_sof >= FRAME_US)) {
+		return;
+	}
+
+	// Past the slot for this frame, the report is read on the next poll anyway
+	if ((uint32_t)target > since_sof) {
+		k_usleep(target - since_sof);
+	}
+}
+#else
+void app_usb_sof_align(void)
+{
+}
+#endif
+
+void app_usb_sof_dump(void)
+{
+	LOG_INF("poll position %u us after SOF", (uint32_t)atomic_get(&m_poll_phase_us));
+
+	for (int i = 0; i < HIST_COUNT; i++) {
+		const struct latency_hist *hist = &m_hist[i];
+
+		LOG_INF("%-6s n=%u p1=%u p50=%u p99=%u max=%u us", hist_name[i],
+			hist->count, latency_hist_percentile(hist, 1),
+			latency_hist_percentile(hist, 50),
+			latency_hist_percentile(hist, 99), hist->max);
+	}
+}
+
+#if CONFIG_SC_DONGLE_HID_SOF_DUMP_INTERVAL > 0
+static void dump_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_dump_work, dump_work_handler);
+
+static void dump_work_handler(struct k_work *work)
+{
+	app_usb_sof_dump();
+	k_work_schedule(&m_dump_work, K_SECONDS(CONFIG_SC_DONGLE_HID_SOF_DUMP_INTERVAL));
+}
+
+static int app_usb_sof_dump_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+	k_work_schedule(&m_dump_work, K_SECONDS(CONFIG_SC_DONGLE_HID_SOF_DUMP_INTERVAL));
+	return 0;
+}
+
+SYS_INIT(app_usb_sof_dump_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif
@@ -6,15 +6,27 @@
  */
 
 #include <zephyr.h>
+#include <string.h>
 
 #include "app_usb_hid.h"
 #include "app_ble_nus_c_handler.h"
+#include "app_remote_protocol.h"
+#include "app_latency.h"
+#include "app_kbd_state.h"
+#include "app_cons_ctrl.h"
+#include "app_keymap.h"
+#include "app_keymap_service.h"
+#include "app_macro.h"
+#include "app_bench.h"
+#include "app_shell.h"
+#include "app_trace.h"
+#include <diag_service.h>
+#include <sc_hid.h>
 #include "dk_buttons_and_leds.h"
 
 #include <logging/log.h>
 
-#define LOG_LEVEL LOG_LEVEL_INF
-LOG_MODULE_REGISTER(main);
+LOG_MODULE_REGISTER(main, CONFIG_SC_LOG_LEVEL);
 
 #define DK_BUTTON1 0
 #define DK_BUTTON2 1
@@ -23,75 +35,211 @@ LOG_MODULE_REGISTER(main);
 #define BUTTON_PRESSED(a) ((has_changed & BIT(a)) && (button_state & BIT(a)))
 #define BUTTON_RELEASED(a) ((has_changed & BIT(a)) && !(button_state & BIT(a)))
 
-static void app_button_handler(uint32_t button_state, uint32_t has_changed)
+// Map a button edge from any source to HID input through the key map
+static void handle_button_event(uint8_t source, uint8_t button, bool pressed)
 {
-	if(BUTTON_PRESSED(DK_BUTTON1)) {
-		app_usb_hid_send_cons_ctrl_packet(BIT(0));
+	uint8_t map_source = (source == APP_KBD_SOURCE_LOCAL) ? APP_KEYMAP_SOURCE_LOCAL :
+								   APP_KEYMAP_SOURCE_REMOTE;
+	struct app_keymap_action action = app_keymap_lookup(map_source, button,
+		pressed ? APP_KEYMAP_EVT_PRESS : APP_KEYMAP_EVT_RELEASE);
+
+	switch(action.type) {
+		case APP_KEYMAP_ACTION_NONE:
+			break;
+
+		case APP_KEYMAP_ACTION_KEY_PRESS:
+			app_kbd_state_press(source, button, (struct app_kbd_action){
+				.modifiers = action.modifiers, .key = action.usage});
+			break;
+
+		case APP_KEYMAP_ACTION_KEY_RELEASE:
+			app_kbd_state_release(source, button);
+			break;
+
+		case APP_KEYMAP_ACTION_CONS_PRESS:
+			app_cons_ctrl_press(source, button, action.usage,
+					    action.modifiers & APP_KEYMAP_CONS_FLAG_REPEAT);
+			break;
+
+		case APP_KEYMAP_ACTION_CONS_RELEASE:
+			app_cons_ctrl_release(source, button);
+			break;
+
+		case APP_KEYMAP_ACTION_LETTER_CYCLE: {
+			static uint8_t key = KEY_A;
+			app_kbd_state_press(source, button, (struct app_kbd_action){
+				.modifiers = action.modifiers, .key = key++});
+			if(key > KEY_Z) key = KEY_A;
+			break;
+		}
+
+		case APP_KEYMAP_ACTION_MACRO:
+			if(IS_ENABLED(CONFIG_SC_DONGLE_MACRO)) {
+				app_macro_play(action.usage);
+			}
+			break;
+
+		default:
+			LOG_ERR("Invalid key map action %u", action.type);
+			break;
 	}
-	if(BUTTON_PRESSED(DK_BUTTON2)) {
-		app_usb_hid_send_cons_ctrl_packet(BIT(1));
+}
+
+static void app_button_handler(uint32_t button_state, uint32_t has_changed)
+{
+	app_latency_local_rx(APP_KBD_SOURCE_LOCAL);
+
+	for(uint8_t button = DK_BUTTON1; button <= DK_BUTTON4; button++) {
+		if(BUTTON_PRESSED(button)) {
+			app_trace_event(APP_TRACE_LOCAL_EVENT, 0, button | BIT(7));
+			handle_button_event(APP_KBD_SOURCE_LOCAL, button, true);
+		} else if(BUTTON_RELEASED(button)) {
+			app_trace_event(APP_TRACE_LOCAL_EVENT, 0, button);
+			handle_button_event(APP_KBD_SOURCE_LOCAL, button, false);
+		}
 	}
-	if(BUTTON_PRESSED(DK_BUTTON3)) {
-		static uint8_t key = KEY_A;
-		app_usb_hid_send_kbd_packet(key++, 0);
-		if(key > KEY_Z) key = KEY_A;
-	} else if(BUTTON_RELEASED(DK_BUTTON3)) {
-		app_usb_hid_send_kbd_packet(0, 0);
+
+	app_kbd_state_commit(APP_KBD_SOURCE_LOCAL);
+}
+
+// One decoder per remote slot, each remote has its own key state source
+static struct app_remote_proto_rx m_remote_rx[CONFIG_SC_DONGLE_MAX_REMOTES];
+
+static inline uint8_t remote_of(const struct app_remote_proto_rx *rx)
+{
+	return rx - m_remote_rx;
+}
+
+static void on_remote_button_event(struct app_remote_proto_rx *rx, uint8_t button,
+				   bool pressed, uint8_t age_ms)
+{
+	app_latency_event(rx->source, age_ms);
+	app_trace_event(APP_TRACE_REMOTE_EVENT, remote_of(rx),
+			button | (pressed ? BIT(7) : 0) | (age_ms << 8));
+	handle_button_event(rx->source, button, pressed);
+}
+
+void on_nus_client_data_received(uint8_t remote, const uint8_t *data_ptr, uint32_t length)
+{
+	app_trace_event(APP_TRACE_FRAME_RX, remote, length);
+
+	// Decode the incoming frame, and forward the button edges to the USB HID interface
+	app_remote_proto_decode(&m_remote_rx[remote], data_ptr, length);
+
+	// All edges in a frame go out together, so chords arrive in a single report.
+	// Keys held by the other remotes stay merged in.
+	app_kbd_state_commit(APP_KBD_SOURCE_REMOTE(remote));
+}
+
+#if defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+// Decoder counters of the remotes that disconnected since boot
+static struct app_remote_proto_stats m_rx_totals;
+
+static void rx_totals_add(struct app_remote_proto_stats *totals,
+			  const struct app_remote_proto_stats *stats)
+{
+	totals->frames += stats->frames;
+	totals->events += stats->events;
+	totals->lost_frames += stats->lost_frames;
+	totals->resyncs += stats->resyncs;
+	totals->malformed += stats->malformed;
+}
+
+// Totals since boot next to the capture summary, checked by scripts/bsim_check.py
+static void sim_summary_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(m_sim_summary_work, sim_summary_work_handler);
+
+static void sim_summary_work_handler(struct k_work *work)
+{
+	struct app_remote_proto_stats totals = m_rx_totals;
+
+	for (int i = 0; i < ARRAY_SIZE(m_remote_rx); i++) {
+		rx_totals_add(&totals, &m_remote_rx[i].stats);
 	}
-	if(BUTTON_PRESSED(DK_BUTTON4)) {
-		app_usb_hid_send_kbd_packet(KEY_M, HID_KBD_REP_FLAG_LEFT_CTRL | HID_KBD_REP_FLAG_LEFT_SHIFT);
-	} else if(BUTTON_RELEASED(DK_BUTTON4)) {
-		app_usb_hid_send_kbd_packet(0, 0);
+
+	LOG_INF("sim: rx %u frames, %u events, %u lost, %u resyncs, %u malformed",
+		totals.frames, totals.events, totals.lost_frames, totals.resyncs,
+		totals.malformed);
+
+	k_work_schedule(&m_sim_summary_work,
+			K_SECONDS(CONFIG_SC_DONGLE_HID_CAPTURE_SUMMARY_INTERVAL));
+}
+#endif
+
+void on_nus_client_disconnected(uint8_t remote)
+{
+	const struct app_remote_proto_stats *stats = &m_remote_rx[remote].stats;
+
+	app_trace_event(APP_TRACE_DISCONNECTED, remote, 0);
+
+	LOG_INF("Remote %u: %u frames, %u events, %u lost, %u resyncs, %u malformed",
+		remote, stats->frames, stats->events, stats->lost_frames,
+		stats->resyncs, stats->malformed);
+
+	// Release anything the remote was holding, the link is gone
+	app_remote_proto_reset(&m_remote_rx[remote]);
+#if defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+	rx_totals_add(&m_rx_totals, &m_remote_rx[remote].stats);
+#endif
+	memset(&m_remote_rx[remote].stats, 0, sizeof(m_remote_rx[remote].stats));
+	app_kbd_state_release_all(APP_KBD_SOURCE_REMOTE(remote));
+	app_kbd_state_commit(APP_KBD_SOURCE_REMOTE(remote));
+	app_cons_ctrl_release_all(APP_KBD_SOURCE_REMOTE(remote));
+}
+
+// The host's idle period ran out, report what is held right now. Released keys
+// are gone from the state, so nothing keeps repeating after a release or a
+// disconnection, even if the report for it was lost.
+static void on_hid_idle(uint8_t report_id)
+{
+	if (report_id == SC_HID_REPORT_ID_CONS_CTRL) {
+		app_cons_ctrl_refresh();
+	} else {
+		app_kbd_state_refresh();
 	}
 }
 
-void on_nus_client_data_received(uint8_t *data_ptr, uint32_t length)
+#if defined(CONFIG_SC_DIAG_SERVICE)
+static void diag_fill(struct diag_buf *buf)
 {
-	// If the length is 2, process incoming packets here, and forward them to the USB HID interface 
-	if(length == 2) {
-		uint8_t button_number = data_ptr[0];
-		bool button_pressed = (data_ptr[1] == '1');
-		switch(button_number) {
-			case '0':
-				// Volume up
-				if(button_pressed) {
-					app_usb_hid_send_cons_ctrl_packet(BIT(0));
-				}
-				break;
-
-			case '1':
-				// Volume down
-				if(button_pressed) {
-					app_usb_hid_send_cons_ctrl_packet(BIT(1));
-				}
-				break;
-
-			case '2':
-				// Send incrementing character (a-z) on press, empty packet on release
-				if(button_pressed) {
-					static uint8_t key = KEY_A;
-					app_usb_hid_send_kbd_packet(key++, 0);
-					if(key > KEY_Z) key = KEY_A;					
-				} else {
-					app_usb_hid_send_kbd_packet(0, 0);
-				}
-				break;
-
-			case '3':
-				// Send CTRL + SHIFT + M on press, empty packet on release
-				if(button_pressed) {
-					app_usb_hid_send_kbd_packet(KEY_M, HID_KBD_REP_FLAG_LEFT_CTRL | HID_KBD_REP_FLAG_LEFT_SHIFT);
-				} else {
-					app_usb_hid_send_kbd_packet(0, 0);
-				}
-				break;
-
-			default:
-				LOG_ERR("Invalid button number received");
-				break;
+	struct app_usb_hid_stats hid;
+
+	app_usb_hid_stats_get(&hid);
+
+	diag_put_u32(buf, DIAG_TLV_HID_REPORTS, hid.direct + hid.queued);
+	diag_put_u32(buf, DIAG_TLV_HID_EP_BUSY, hid.ep_busy);
+	diag_put_u32(buf, DIAG_TLV_HID_DROPPED, hid.dropped);
+	diag_put_u32(buf, DIAG_TLV_HID_EP_TIMEOUTS, hid.ep_timeouts);
+	diag_put_u32(buf, DIAG_TLV_QUEUE_HWM, hid.queue_hwm);
+	diag_put_u32(buf, DIAG_TLV_CONNECTS, app_ble_nus_c_connect_count());
+
+	// Decoder counters of each connected remote, since it connected, and the
+	// counters the remote sent about itself
+	for (uint8_t i = 0; i < ARRAY_SIZE(m_remote_rx); i++) {
+		static uint8_t remote_diag[SC_PROTO_STATS_MAX_SIZE];
+		struct bt_conn *conn = app_ble_nus_c_conn_get(i);
+		const struct app_remote_proto_stats *stats = &m_remote_rx[i].stats;
+		uint32_t age_ms;
+		uint8_t len;
+
+		if (!conn) {
+			continue;
+		}
+
+		diag_put_link(buf, i, conn);
+		bt_conn_unref(conn);
+		diag_put_u32(buf, DIAG_TLV_FRAMES, stats->frames);
+		diag_put_u32(buf, DIAG_TLV_EVENTS, stats->events);
+		diag_put_u32(buf, DIAG_TLV_FRAMES_LOST, stats->lost_frames);
+		diag_put_u32(buf, DIAG_TLV_RESYNCS, stats->resyncs);
+
+		len = app_remote_proto_diag_get(&m_remote_rx[i], remote_diag, &age_ms);
+		if (len) {
+			diag_put_bytes(buf, DIAG_TLV_REMOTE, remote_diag, len);
 		}
 	}
 }
+#endif
 
 void main(void)
 {
@@ -99,19 +247,53 @@ void main(void)
 
 	LOG_INF("Starting Shortcut Remote Dongle application");
 
-	ret = dk_buttons_init(app_button_handler);
-	if(ret != 0) {
-		LOG_ERR("Unable to initialize DK buttons!");
+	for(int i = 0; i < ARRAY_SIZE(m_remote_rx); i++) {
+		m_remote_rx[i].on_event = on_remote_button_event;
+		m_remote_rx[i].source = APP_KBD_SOURCE_REMOTE(i);
 	}
 
+	app_shell_init(m_remote_rx, ARRAY_SIZE(m_remote_rx));
+
+	// Defaults first, a stored map replaces them when settings are loaded
+	app_keymap_init();
+
+	if(IS_ENABLED(CONFIG_DK_LIBRARY)) {
+		ret = dk_buttons_init(app_button_handler);
+		if(ret != 0) {
+			LOG_ERR("Unable to initialize DK buttons!");
+		}
+	}
+
+	app_usb_hid_idle_handler_set(on_hid_idle);
 	ret = app_usb_hid_init();
 	if(ret != 0) {
 		LOG_ERR("Unable to initialize USB HID: %d", ret);
 	}
 
-	app_ble_nus_c_config_t nus_c_config = {.on_data_received = on_nus_client_data_received};
+	app_ble_nus_c_config_t nus_c_config = {.on_data_received = on_nus_client_data_received,
+						.on_disconnected = on_nus_client_disconnected};
 	ret = app_ble_nus_c_init(&nus_c_config);
 	if(ret != 0) {
 		LOG_ERR("Unable to initialize BLE Nus client!");
 	}
+
+#if defined(CONFIG_SC_DONGLE_HID_CAPTURE)
+	k_work_schedule(&m_sim_summary_work,
+			K_SECONDS(CONFIG_SC_DONGLE_HID_CAPTURE_SUMMARY_INTERVAL));
+#endif
+
+	if(IS_ENABLED(CONFIG_SC_DONGLE_BENCH)) {
+		app_bench_start(&nus_c_config);
+	}
+
+#if defined(CONFIG_SC_DIAG_SERVICE)
+	diag_service_init(diag_fill);
+#endif
+
+	if(IS_ENABLED(CONFIG_SC_DONGLE_KEYMAP_SERVICE)) {
+		ret = app_keymap_service_init();
+		if(ret != 0) {
+			LOG_ERR("Unable to start the configuration service: %d", ret);
+		}
+	}
 }
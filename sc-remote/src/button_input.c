@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/*
+ * Each button reports the first edge straight from its interrupt, then
+ * masks the interrupt for one debounce window so the bounces that follow
+ * cost nothing. When the window closes the pin is sampled once; if it
+ * settled on the other level that edge is reported and a new window
+ * starts, otherwise the interrupt is armed again. The interrupt drops edges
+ * that leave the pin at the reported level, so an edge latched while it was
+ * masked is not reported twice. Nothing runs between presses.
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/gpio.h>
+
+#include <errno.h>
+
+#include "button_input.h"
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(button_input, CONFIG_SC_LOG_LEVEL);
+
+#define BUTTON_SPEC(alias) GPIO_DT_SPEC_GET(DT_ALIAS(alias), gpios)
+
+static const struct gpio_dt_spec button_specs[] = {
+#if DT_NODE_EXISTS(DT_ALIAS(sw0))
+	BUTTON_SPEC(sw0),
+#endif
+#if DT_NODE_EXISTS(DT_ALIAS(sw1))
+	BUTTON_SPEC(sw1),
+#endif
+#if DT_NODE_EXISTS(DT_ALIAS(sw2))
+	BUTTON_SPEC(sw2),
+#endif
+#if DT_NODE_EXISTS(DT_ALIAS(sw3))
+	BUTTON_SPEC(sw3),
+#endif
+};
+
+#define BUTTON_COUNT ARRAY_SIZE(button_specs)
+
+struct button {
+	struct gpio_callback gpio_cb;
+	struct k_timer debounce;
+	uint16_t debounce_ms;
+	/* Level last handed to the handler */
+	bool pressed;
+	/* Edge interrupt enabled, outside a debounce window */
+	bool armed;
+};
+
+static struct button buttons[BUTTON_COUNT];
+static button_input_handler_t handler;
+
+/* The GPIO and timer interrupts can have different priorities, this keeps
+ * the edges of all buttons in order for the handler.
+ */
+static struct k_spinlock lock;
+
+static void button_report(struct button *btn, bool pressed, uint32_t timestamp)
+{
+	size_t i = btn - buttons;
+
+	btn->pressed = pressed;
+	btn->armed = false;
+	handler(i, pressed, timestamp);
+
+	gpio_pin_interrupt_configure_dt(&button_specs[i], GPIO_INT_DISABLE);
+	k_timer_start(&btn->debounce, K_MSEC(btn->debounce_ms), K_NO_WAIT);
+}
+
+static void button_isr(const struct device *port, struct gpio_callback *cb,
+		       gpio_port_pins_t pins)
+{
+	uint32_t timestamp = k_cycle_get_32();
+	struct button *btn = CONTAINER_OF(cb, struct button, gpio_cb);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int level;
+
+	/* An edge latched before the interrupt was masked, the window that
+	 * followed it takes care of the pin.
+	 */
+	if (!btn->armed) {
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	/* A pin back at the reported level is a bounce, or an edge the window
+	 * already reported. Otherwise it changed, even if it is still bouncing.
+	 */
+	level = gpio_pin_get_dt(&button_specs[btn - buttons]);
+	if ((level < 0) || ((bool)level != btn->pressed)) {
+		button_report(btn, !btn->pressed, timestamp);
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+static void debounce_expired(struct k_timer *timer)
+{
+	struct button *btn = CONTAINER_OF(timer, struct button, debounce);
+	const struct gpio_dt_spec *spec = &button_specs[btn - buttons];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int level;
+
+	level = gpio_pin_get_dt(spec);
+	if ((level >= 0) && ((bool)level != btn->pressed)) {
+		/* Released, or pressed again, inside the window */
+		button_report(btn, level, k_cycle_get_32());
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	gpio_pin_interrupt_configure_dt(spec, GPIO_INT_EDGE_BOTH);
+	btn->armed = true;
+
+	/* An edge between the sample and arming raised no interrupt */
+	level = gpio_pin_get_dt(spec);
+	if ((level >= 0) && ((bool)level != btn->pressed)) {
+		button_report(btn, level, k_cycle_get_32());
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+int button_input_debounce_set(uint8_t button, uint16_t debounce_ms)
+{
+	k_spinlock_key_t key;
+
+	if ((button >= BUTTON_COUNT) || !debounce_ms) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&lock);
+	buttons[button].debounce_ms = debounce_ms;
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+int button_input_init(button_input_handler_t input_handler)
+{
+	int err;
+
+	if (!input_handler) {
+		return -EINVAL;
+	}
+
+	handler = input_handler;
+
+	for (size_t i = 0; i < BUTTON_COUNT; i++) {
+		const struct gpio_dt_spec *spec = &button_specs[i];
+		struct button *btn = &buttons[i];
+
+		if (!device_is_ready(spec->port)) {
+			LOG_ERR("Button %u port not ready", i);
+			return -ENODEV;
+		}
+
+		err = gpio_pin_configure_dt(spec, GPIO_INPUT);
+		if (err) {
+			LOG_ERR("Cannot configure button %u (err %d)", i, err);
+			return err;
+		}
+
+		btn->debounce_ms = CONFIG_SC_REMOTE_BUTTON_DEBOUNCE_MS;
+		btn->pressed = (gpio_pin_get_dt(spec) > 0);
+		btn->armed = true;
+		k_timer_init(&btn->debounce, debounce_expired, NULL);
+
+		gpio_init_callback(&btn->gpio_cb, button_isr, BIT(spec->pin));
+		err = gpio_add_callback(spec->port, &btn->gpio_cb);
+		if (err) {
+			LOG_ERR("Cannot add button %u callback (err %d)", i, err);
+			return err;
+		}
+
+		err = gpio_pin_interrupt_configure_dt(spec, GPIO_INT_EDGE_BOTH);
+		if (err) {
+			LOG_ERR("Cannot enable button %u interrupt (err %d)", i, err);
+			return err;
+		}
+	}
+
+	LOG_INF("%u buttons, %u ms debounce", BUTTON_COUNT,
+		CONFIG_SC_REMOTE_BUTTON_DEBOUNCE_MS);
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Interrupt driven button input with per-button debounce
+ */
+
+#ifndef BUTTON_INPUT_H_
+#define BUTTON_INPUT_H_
+
+#include <zephyr/types.h>
+
+/* Called from interrupt context for every edge, one call at a time.
+ * The timestamp is k_cycle_get_32() taken when the edge was seen.
+ */
+typedef void (*button_input_handler_t)(uint8_t button, bool pressed,
+				       uint32_t timestamp);
+
+/* Configure the sw0..sw3 buttons and enable their interrupts */
+int button_input_init(button_input_handler_t handler);
+
+/* Change the debounce window of one button, see SC_REMOTE_BUTTON_DEBOUNCE_MS */
+int button_input_debounce_set(uint8_t button, uint16_t debounce_ms);
+
+#endif /* BUTTON_INPUT_H_ */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include "event_ring.h"
+
+#define EVENT_RING_MASK (EVENT_RING_SIZE - 1)
+
+bool event_ring_put(struct event_ring *ring, const struct button_event *evt)
+{
+	atomic_val_t head = atomic_get(&ring->head);
+	atomic_val_t used = head - atomic_get(&ring->tail);
+
+	if (used >= EVENT_RING_SIZE) {
+		atomic_inc(&ring->overflows);
+		return false;
+	}
+
+	ring->buf[head & EVENT_RING_MASK] = *evt;
+
+	/* Publish the slot only once it is completely written */
+	atomic_set(&ring->head, head + 1);
+
+	if (used + 1 > atomic_get(&ring->high_watermark)) {
+		atomic_set(&ring->high_watermark, used + 1);
+	}
+
+	return true;
+}
+
+bool event_ring_get(struct event_ring *ring, struct button_event *evt)
+{
+	atomic_val_t tail = atomic_get(&ring->tail);
+
+	if (tail == atomic_get(&ring->head)) {
+		return false;
+	}
+
+	*evt = ring->buf[tail & EVENT_RING_MASK];
+
+	/* Hand the slot back to the producer once it has been copied out */
+	atomic_set(&ring->tail, tail + 1);
+
+	return true;
+}
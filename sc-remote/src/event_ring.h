@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Single producer, single consumer ring of button events
+ */
+
+#ifndef EVENT_RING_H_
+#define EVENT_RING_H_
+
+#include <zephyr/types.h>
+#include <sys/atomic.h>
+#include <sys/util.h>
+
+#define EVENT_RING_SIZE CONFIG_SC_REMOTE_EVENT_RING_SIZE
+
+BUILD_ASSERT(IS_POWER_OF_TWO(EVENT_RING_SIZE),
+	     "Event ring size must be a power of two");
+
+struct button_event {
+	/* k_cycle_get_32() when the edge was seen */
+	uint32_t timestamp;
+	uint8_t button;
+	bool pressed;
+};
+
+/* Only the producer writes head, only the consumer writes tail. */
+struct event_ring {
+	atomic_t head;
+	atomic_t tail;
+	atomic_t overflows;
+	atomic_t high_watermark;
+	struct button_event buf[EVENT_RING_SIZE];
+};
+
+/* Producer side. Returns false, and counts an overflow, if the ring is full. */
+bool event_ring_put(struct event_ring *ring, const struct button_event *evt);
+
+/* Consumer side. Returns false if the ring is empty. */
+bool event_ring_get(struct event_ring *ring, struct button_event *evt);
+
+static inline uint32_t event_ring_overflows(struct event_ring *ring)
+{
+	return (uint32_t)atomic_get(&ring->overflows);
+}
+
+static inline uint32_t event_ring_high_watermark(struct event_ring *ring)
+{
+	return (uint32_t)atomic_get(&ring->high_watermark);
+}
+
+#endif /* EVENT_RING_H_ */
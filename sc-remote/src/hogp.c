@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/*
+ * The remote as a HID over GATT keyboard. Reports and the default button
+ * mapping are the same as the dongle's, so the host sees the same device
+ * without the second radio to USB hop.
+ */
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/services/hids.h>
+#include <sys/byteorder.h>
+
+#include <sc_hid.h>
+#if defined(CONFIG_SC_REMOTE_HOGP_LATENCY)
+#include <latency_hist.h>
+#endif
+
+#include "hogp.h"
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(hogp, CONFIG_SC_LOG_LEVEL);
+
+#define BASE_USB_HID_SPEC_VERSION 0x0101
+
+#define INPUT_REP_KBD_IDX	0
+#define INPUT_REP_CONS_IDX	1
+
+#define BUTTON_COUNT		4
+
+#define MOD_LEFT_CTRL		BIT(0)
+#define MOD_LEFT_SHIFT		BIT(1)
+#define KEY_A			0x04
+#define KEY_M			0x10
+#define LETTER_COUNT		26
+
+#define RETRY_DELAY_MAX_MS	50
+
+BT_HIDS_DEF(hids_obj, SC_HID_KBD_REPORT_SIZE, SC_HID_CONS_CTRL_REPORT_SIZE);
+
+static const uint8_t report_map[] = {
+	SC_HID_REPORT_DESC_KBD_START,
+	SC_HID_REPORT_DESC_KBD_KEYS,
+	SC_HID_REPORT_DESC_KBD_END,
+	SC_HID_REPORT_DESC_CONS_CTRL
+};
+
+static struct bt_conn *hid_conn;
+
+/* Keys held by each button, the keyboard report is built from these */
+static struct {
+	uint8_t modifiers;
+	uint8_t key;
+} held[BUTTON_COUNT];
+
+/* Consumer usage held by each button, 0 when released */
+static uint16_t cons_held[BUTTON_COUNT];
+static uint8_t next_letter;
+
+#if defined(CONFIG_SC_REMOTE_HOGP_LATENCY)
+enum {
+	STAGE_REMOTE,	/* Button edge to bt_hids_inp_rep_send() */
+	STAGE_LINK,	/* Send to the notification being transmitted */
+	STAGE_TOTAL,
+	STAGE_COUNT
+};
+
+static const char *const stage_name[STAGE_COUNT] = {
+	[STAGE_REMOTE] = "remote",
+	[STAGE_LINK] = "link",
+	[STAGE_TOTAL] = "total",
+};
+
+static struct latency_hist hist[STAGE_COUNT];
+
+/* Stamps of the reports in flight, completions come back in order. The
+ * sender only writes the head, and the completion side, on the system
+ * workqueue, only the tail.
+ */
+#define STAMP_COUNT 8
+
+static struct {
+	uint32_t edge;
+	uint32_t sent;
+} stamps[STAMP_COUNT];
+static atomic_t stamp_head;
+static atomic_t stamp_tail;
+/* Reports sent without a stamp, the ring was full */
+static atomic_t stamps_dropped;
+
+static bool stamp_push(uint32_t edge)
+{
+	atomic_val_t head = atomic_get(&stamp_head);
+
+	/* Completions that never came, for reports nobody subscribed to */
+	if ((head - atomic_get(&stamp_tail)) >= STAMP_COUNT) {
+		atomic_inc(&stamps_dropped);
+		return false;
+	}
+
+	stamps[head % STAMP_COUNT].edge = edge;
+	stamps[head % STAMP_COUNT].sent = k_cycle_get_32();
+	atomic_set(&stamp_head, head + 1);
+	return true;
+}
+
+static void stamp_unpush(void)
+{
+	atomic_dec(&stamp_head);
+}
+
+/* The link is gone, and so are the completions of its reports */
+static void stamp_flush_work_handler(struct k_work *work)
+{
+	atomic_set(&stamp_tail, atomic_get(&stamp_head));
+}
+
+static K_WORK_DEFINE(stamp_flush_work, stamp_flush_work_handler);
+
+static void report_sent(struct bt_conn *conn, void *user_data)
+{
+	atomic_val_t tail = atomic_get(&stamp_tail);
+	uint32_t now = k_cycle_get_32();
+
+	if (tail == atomic_get(&stamp_head)) {
+		return;
+	}
+
+	latency_hist_add(&hist[STAGE_REMOTE],
+			 k_cyc_to_us_floor32(stamps[tail % STAMP_COUNT].sent -
+					     stamps[tail % STAMP_COUNT].edge));
+	latency_hist_add(&hist[STAGE_LINK],
+			 k_cyc_to_us_floor32(now - stamps[tail % STAMP_COUNT].sent));
+	latency_hist_add(&hist[STAGE_TOTAL],
+			 k_cyc_to_us_floor32(now - stamps[tail % STAMP_COUNT].edge));
+	atomic_set(&stamp_tail, tail + 1);
+}
+
+static void latency_dump(void)
+{
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		LOG_INF("%-6s n=%u p50=%u p99=%u max=%u mean=%u us", stage_name[i],
+			hist[i].count, latency_hist_percentile(&hist[i], 50),
+			latency_hist_percentile(&hist[i], 99), hist[i].max,
+			latency_hist_mean(&hist[i]));
+	}
+	LOG_INF("%u reports not timed", (uint32_t)atomic_get(&stamps_dropped));
+}
+
+static void dump_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(dump_work, dump_work_handler);
+
+static void dump_work_handler(struct k_work *work)
+{
+	latency_dump();
+	k_work_schedule(&dump_work, K_SECONDS(CONFIG_SC_REMOTE_HOGP_LATENCY_DUMP_INTERVAL));
+}
+#else
+static inline bool stamp_push(uint32_t edge)
+{
+	return false;
+}
+static inline void stamp_unpush(void) {}
+#define report_sent NULL
+#endif /* CONFIG_SC_REMOTE_HOGP_LATENCY */
+
+static void report_send(uint8_t rep_index, const uint8_t *rep, uint8_t len,
+			uint32_t edge)
+{
+	uint32_t backoff = CONFIG_SC_REMOTE_TX_RETRY_DELAY_MS;
+	int err;
+
+	if (!hid_conn) {
+		return;
+	}
+
+	for (int attempt = 0;; attempt++) {
+		bool stamped = stamp_push(edge);
+
+		err = bt_hids_inp_rep_send(&hids_obj, hid_conn, rep_index, rep, len,
+					   report_sent);
+		if (!err) {
+			return;
+		}
+		if (stamped) {
+			stamp_unpush();
+		}
+
+		if ((err != -ENOMEM) || (attempt >= CONFIG_SC_REMOTE_TX_RETRY_MAX)) {
+			break;
+		}
+
+		/* Out of buffers, back off and let the link drain */
+		k_sleep(K_MSEC(backoff));
+		backoff = MIN(backoff * 2, RETRY_DELAY_MAX_MS);
+	}
+
+	LOG_WRN("Failed to send HID report (err %d)", err);
+}
+
+static void kbd_report_send(uint32_t edge)
+{
+	uint8_t rep[SC_HID_KBD_REPORT_SIZE] = {0};
+	int count = 0;
+
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		rep[0] |= held[i].modifiers;
+		if (held[i].key && (count < SC_HID_KBD_ROLLOVER)) {
+			rep[2 + count++] = held[i].key;
+		}
+	}
+
+	report_send(INPUT_REP_KBD_IDX, rep, sizeof(rep), edge);
+}
+
+static void cons_ctrl_report_send(uint32_t edge)
+{
+	uint8_t rep[SC_HID_CONS_CTRL_REPORT_SIZE] = {0};
+	int count = 0;
+
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		if (cons_held[i] && (count < SC_HID_CONS_CTRL_SLOTS)) {
+			sys_put_le16(cons_held[i], &rep[2 * count++]);
+		}
+	}
+
+	report_send(INPUT_REP_CONS_IDX, rep, sizeof(rep), edge);
+}
+
+void hogp_button_event(const struct button_event *evt)
+{
+	if (evt->button >= BUTTON_COUNT) {
+		return;
+	}
+
+	switch (evt->button) {
+	case 0:
+	case 1:
+		/* Volume up and down */
+		cons_held[evt->button] = !evt->pressed ? 0 :
+			((evt->button == 0) ? SC_HID_CONS_VOLUME_UP : SC_HID_CONS_VOLUME_DOWN);
+		cons_ctrl_report_send(evt->timestamp);
+		return;
+	case 2:
+		/* Hold the next letter of the alphabet */
+		if (evt->pressed) {
+			held[2].key = KEY_A + next_letter;
+			next_letter = (next_letter + 1) % LETTER_COUNT;
+		} else {
+			held[2].key = 0;
+		}
+		break;
+	case 3:
+		/* CTRL + SHIFT + M */
+		held[3].modifiers = evt->pressed ? (MOD_LEFT_CTRL | MOD_LEFT_SHIFT) : 0;
+		held[3].key = evt->pressed ? KEY_M : 0;
+		break;
+	}
+
+	kbd_report_send(evt->timestamp);
+}
+
+static void hids_pm_evt_handler(enum bt_hids_pm_evt evt, struct bt_conn *conn)
+{
+	LOG_INF("Protocol mode: %s",
+		(evt == BT_HIDS_PM_EVT_BOOT_MODE_ENTERED) ? "boot" : "report");
+}
+
+void hogp_connected(struct bt_conn *conn)
+{
+	int err = bt_hids_connected(&hids_obj, conn);
+
+	if (err) {
+		LOG_ERR("HIDS connect failed (err %d)", err);
+		return;
+	}
+
+	hid_conn = bt_conn_ref(conn);
+}
+
+void hogp_disconnected(struct bt_conn *conn)
+{
+	if (conn != hid_conn) {
+		return;
+	}
+
+	bt_hids_disconnected(&hids_obj, conn);
+	bt_conn_unref(hid_conn);
+	hid_conn = NULL;
+
+	/* Nothing is held on the host once the link is gone */
+	memset(held, 0, sizeof(held));
+	memset(cons_held, 0, sizeof(cons_held));
+
+#if defined(CONFIG_SC_REMOTE_HOGP_LATENCY)
+	k_work_submit(&stamp_flush_work);
+	latency_dump();
+#endif
+}
+
+int hogp_init(void)
+{
+	struct bt_hids_init_param hids_init_obj = { 0 };
+	struct bt_hids_inp_rep *hids_inp_rep;
+	int err;
+
+	hids_init_obj.rep_map.data = report_map;
+	hids_init_obj.rep_map.size = sizeof(report_map);
+
+	hids_init_obj.info.bcd_hid = BASE_USB_HID_SPEC_VERSION;
+	hids_init_obj.info.b_country_code = 0x00;
+	hids_init_obj.info.flags = (BT_HIDS_REMOTE_WAKE |
+				    BT_HIDS_NORMALLY_CONNECTABLE);
+
+	hids_inp_rep = &hids_init_obj.inp_rep_group_init.reports[INPUT_REP_KBD_IDX];
+	hids_inp_rep->size = SC_HID_KBD_REPORT_SIZE;
+	hids_inp_rep->id = SC_HID_REPORT_ID_KBD;
+	hids_init_obj.inp_rep_group_init.cnt++;
+
+	hids_inp_rep = &hids_init_obj.inp_rep_group_init.reports[INPUT_REP_CONS_IDX];
+	hids_inp_rep->size = SC_HID_CONS_CTRL_REPORT_SIZE;
+	hids_inp_rep->id = SC_HID_REPORT_ID_CONS_CTRL;
+	hids_init_obj.inp_rep_group_init.cnt++;
+
+	hids_init_obj.pm_evt_handler = hids_pm_evt_handler;
+
+	err = bt_hids_init(&hids_obj, &hids_init_obj);
+	if (err) {
+		LOG_ERR("HIDS init failed (err %d)", err);
+		return err;
+	}
+
+#if defined(CONFIG_SC_REMOTE_HOGP_LATENCY)
+	k_work_schedule(&dump_work, K_SECONDS(CONFIG_SC_REMOTE_HOGP_LATENCY_DUMP_INTERVAL));
+#endif
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief HID over GATT, for hosts that pair with the remote directly
+ */
+
+#ifndef HOGP_H_
+#define HOGP_H_
+
+#include <bluetooth/conn.h>
+
+#include "event_ring.h"
+
+/* Register the HID service. Call before bt_enable(). */
+int hogp_init(void);
+
+void hogp_connected(struct bt_conn *conn);
+void hogp_disconnected(struct bt_conn *conn);
+
+/* Turn a button edge into keyboard or consumer control reports */
+void hogp_button_event(const struct button_event *evt);
+
+#endif /* HOGP_H_ */
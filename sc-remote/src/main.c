@@ -22,16 +22,29 @@
 
 #include <bluetooth/services/nus.h>
 
+#include <sc_protocol.h>
+#include <conn_params.h>
+#include <link_setup.h>
+#include <sc_log.h>
+#include <diag_service.h>
+
+#include "event_ring.h"
+#include "sim_input.h"
+#include "button_input.h"
+#include "hogp.h"
+
 #include <dk_buttons_and_leds.h>
 
 #include <settings/settings.h>
 
 #include <stdio.h>
 
+#include <sys/byteorder.h>
+
 #include <logging/log.h>
 
 #define LOG_MODULE_NAME peripheral_uart
-LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+LOG_MODULE_REGISTER(LOG_MODULE_NAME, CONFIG_SC_LOG_LEVEL);
 
 #define STACKSIZE CONFIG_BT_NUS_THREAD_STACK_SIZE
 #define PRIORITY 7
@@ -44,69 +57,161 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
 #define CON_STATUS_LED DK_LED2
 
-#define KEY_PASSKEY_ACCEPT DK_BTN1_MSK
-#define KEY_PASSKEY_REJECT DK_BTN2_MSK
+#if defined(CONFIG_DK_LIBRARY)
+#define STATUS_LED_SET(led, on) dk_set_led(led, on)
+#else
+/* Simulated boards have no LEDs */
+#define STATUS_LED_SET(led, on)
+#endif
+
+#define FRAME_BUF_SIZE CONFIG_BT_NUS_UART_BUFFER_SIZE
+#define FRAME_MAX_EVENTS SC_PROTO_MAX_EVENTS(FRAME_BUF_SIZE)
 
-#define UART_BUF_SIZE CONFIG_BT_NUS_UART_BUFFER_SIZE
-#define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
-#define UART_WAIT_FOR_RX CONFIG_BT_NUS_UART_RX_WAIT_TIME
+#define TX_RETRY_DELAY_MAX_MS 50
 
 static K_SEM_DEFINE(ble_init_ok, 0, 1);
 
+/* Set and cleared by the connection callbacks, read from other threads
+ * through current_conn_get()
+ */
 static struct bt_conn *current_conn;
+static struct k_spinlock current_conn_lock;
 static struct bt_conn *auth_conn;
 
-struct uart_data_t {
-	void *fifo_reserved;
-	uint8_t data[UART_BUF_SIZE];
-	uint16_t len;
-};
+/* Button events from the button callback to the BLE write thread */
+static struct event_ring button_events;
+static K_SEM_DEFINE(button_events_sem, 0, 1);
 
-static K_FIFO_DEFINE(fifo_uart_rx_data);
+/* Live button state, kept by the producer to recover from ring overflows */
+static atomic_t button_state_live;
+
+/* Passkey replies are made from the system workqueue, not the button IRQ */
+static atomic_t passkey_accept;
+
+/* Notifications handed to the stack and not yet completed. Each one holds
+ * a credit, so no more than CONFIG_SC_REMOTE_TX_IN_FLIGHT are outstanding.
+ */
+static K_SEM_DEFINE(tx_credits, CONFIG_SC_REMOTE_TX_IN_FLIGHT,
+		    CONFIG_SC_REMOTE_TX_IN_FLIGHT);
+
+static struct {
+	atomic_t events;
+	atomic_t events_sent;
+	atomic_t connects;
+	atomic_t in_flight;
+	atomic_t in_flight_max;
+	atomic_t frames;
+	atomic_t coalesced;
+	atomic_t retries;
+	atomic_t drops;
+} tx_stats;
+
+#if defined(CONFIG_SC_REMOTE_STATS_FORWARD)
+/* Counters sent to the dongle while connected to it */
+static void stats_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(stats_work, stats_work_handler);
+#endif
 
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
 };
 
+#if defined(CONFIG_SC_REMOTE_HOGP)
+/* Hosts look for the HID service, the dongle won't pick this remote up */
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_GAP_APPEARANCE,
+		      (CONFIG_BT_DEVICE_APPEARANCE >> 0) & 0xff,
+		      (CONFIG_BT_DEVICE_APPEARANCE >> 8) & 0xff),
+	BT_DATA_BYTES(BT_DATA_UUID16_ALL, BT_UUID_16_ENCODE(BT_UUID_HIDS_VAL)),
+};
+#else
 static const struct bt_data sd[] = {
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_128_ENCODE(0x988f9c8d, 0x2b03, 0x489f, 0xa102, 0x4d83463b90f3)),
 };
+#endif
+
+/* Reference to the connection to the dongle, or NULL. Release it with
+ * bt_conn_unref().
+ */
+static struct bt_conn *current_conn_get(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&current_conn_lock);
+	struct bt_conn *conn = current_conn ? bt_conn_ref(current_conn) : NULL;
+
+	k_spin_unlock(&current_conn_lock, key);
+	return conn;
+}
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	k_spinlock_key_t key;
 
 	if (err) {
 		LOG_ERR("Connection failed (err %u)", err);
 		return;
 	}
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-	LOG_INF("Connected %s", log_strdup(addr));
+	LOG_INF("Connected " SC_ADDR_FMT, SC_ADDR_ARGS(addr));
 
+	key = k_spin_lock(&current_conn_lock);
 	current_conn = bt_conn_ref(conn);
+	k_spin_unlock(&current_conn_lock, key);
+	atomic_inc(&tx_stats.connects);
 
-	dk_set_led_on(CON_STATUS_LED);
+#if defined(CONFIG_SC_REMOTE_STATS_FORWARD)
+	k_work_reschedule(&stats_work, K_SECONDS(CONFIG_SC_REMOTE_STATS_INTERVAL));
+#endif
+
+	if (IS_ENABLED(CONFIG_SC_REMOTE_HOGP)) {
+		hogp_connected(conn);
+	}
+
+	STATUS_LED_SET(CON_STATUS_LED, 1);
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	struct bt_conn *old_conn;
+	k_spinlock_key_t key;
+
+	LOG_INF("Disconnected: " SC_ADDR_FMT " (reason %u)", SC_ADDR_ARGS(addr), reason);
+	LOG_INF("TX: %u frames, %u coalesced edges, %u retries, %u dropped, "
+		"max %u in flight",
+		(uint32_t)atomic_get(&tx_stats.frames),
+		(uint32_t)atomic_get(&tx_stats.coalesced),
+		(uint32_t)atomic_get(&tx_stats.retries),
+		(uint32_t)atomic_get(&tx_stats.drops),
+		(uint32_t)atomic_get(&tx_stats.in_flight_max));
+
+#if defined(CONFIG_SC_REMOTE_STATS_FORWARD)
+	k_work_cancel_delayable(&stats_work);
+#endif
 
-	LOG_INF("Disconnected: %s (reason %u)", log_strdup(addr), reason);
+	/* Completions for the link may never come, hand their credits back */
+	for (atomic_val_t n = atomic_set(&tx_stats.in_flight, 0); n > 0; n--) {
+		k_sem_give(&tx_credits);
+	}
 
 	if (auth_conn) {
 		bt_conn_unref(auth_conn);
 		auth_conn = NULL;
 	}
 
-	if (current_conn) {
-		bt_conn_unref(current_conn);
-		current_conn = NULL;
-		dk_set_led_off(CON_STATUS_LED);
+	if (IS_ENABLED(CONFIG_SC_REMOTE_HOGP)) {
+		hogp_disconnected(conn);
+	}
+
+	key = k_spin_lock(&current_conn_lock);
+	old_conn = current_conn;
+	current_conn = NULL;
+	k_spin_unlock(&current_conn_lock, key);
+
+	if (old_conn) {
+		bt_conn_unref(old_conn);
+		STATUS_LED_SET(CON_STATUS_LED, 0);
 	}
 }
 
@@ -114,15 +219,13 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 static void security_changed(struct bt_conn *conn, bt_security_t level,
 			     enum bt_security_err err)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
 	if (!err) {
-		LOG_INF("Security changed: %s level %u", log_strdup(addr),
+		LOG_INF("Security changed: " SC_ADDR_FMT " level %u", SC_ADDR_ARGS(addr),
 			level);
 	} else {
-		LOG_WRN("Security failed: %s level %u err %d", log_strdup(addr),
+		LOG_WRN("Security failed: " SC_ADDR_FMT " level %u err %d", SC_ADDR_ARGS(addr),
 			level, err);
 	}
 }
@@ -139,54 +242,44 @@ static struct bt_conn_cb conn_callbacks = {
 #if defined(CONFIG_BT_NUS_SECURITY_ENABLED)
 static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	LOG_INF("Passkey for %s: %06u", log_strdup(addr), passkey);
+	LOG_INF("Passkey for " SC_ADDR_FMT ": %06u", SC_ADDR_ARGS(addr), passkey);
 }
 
 static void auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
 	auth_conn = bt_conn_ref(conn);
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
-	LOG_INF("Passkey for %s: %06u", log_strdup(addr), passkey);
+	LOG_INF("Passkey for " SC_ADDR_FMT ": %06u", SC_ADDR_ARGS(addr), passkey);
 	LOG_INF("Press Button 1 to confirm, Button 2 to reject.");
 }
 
 
 static void auth_cancel(struct bt_conn *conn)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	LOG_INF("Pairing cancelled: %s", log_strdup(addr));
+	LOG_INF("Pairing cancelled: " SC_ADDR_FMT, SC_ADDR_ARGS(addr));
 }
 
 
 static void pairing_complete(struct bt_conn *conn, bool bonded)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
-	LOG_INF("Pairing completed: %s, bonded: %d", log_strdup(addr),
+	LOG_INF("Pairing completed: " SC_ADDR_FMT ", bonded: %d", SC_ADDR_ARGS(addr),
 		bonded);
 }
 
 
 static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	LOG_INF("Pairing failed conn: %s, reason %d", log_strdup(addr),
+	LOG_INF("Pairing failed conn: " SC_ADDR_FMT ", reason %d", SC_ADDR_ARGS(addr),
 		reason);
 }
 
@@ -208,13 +301,31 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 
 }
 
+static void bt_sent_cb(struct bt_conn *conn)
+{
+	atomic_val_t in_flight;
+
+	/* Ignore late completions for a link whose credits were returned */
+	do {
+		in_flight = atomic_get(&tx_stats.in_flight);
+		if (in_flight <= 0) {
+			return;
+		}
+	} while (!atomic_cas(&tx_stats.in_flight, in_flight, in_flight - 1));
+
+	k_sem_give(&tx_credits);
+}
+
 static struct bt_nus_cb nus_cb = {
 	.received = bt_receive_cb,
+	.sent = bt_sent_cb,
 };
 
 void error(void)
 {
+#if defined(CONFIG_DK_LIBRARY)
 	dk_set_leds_state(DK_ALL_LEDS_MSK, DK_NO_LEDS_MSK);
+#endif
 
 	while (true) {
 		/* Spin for ever */
@@ -237,71 +348,131 @@ static void num_comp_reply(bool accept)
 	auth_conn = NULL;
 }
 
+static void passkey_work_handler(struct k_work *work)
+{
+	if (auth_conn) {
+		num_comp_reply(atomic_get(&passkey_accept));
+	}
+}
+
+static K_WORK_DEFINE(passkey_work, passkey_work_handler);
+
 #define DK_BUTTON1 0
 #define DK_BUTTON2 1
 #define DK_BUTTON3 2
 #define DK_BUTTON4 3
-#define BUTTON_CHANGED(a) (has_changed & BIT(a))
-#define BUTTON_PRESSED(a) ((has_changed & BIT(a)) && (button_state & BIT(a)))
+#define BUTTON_COUNT 4
 
-static struct uart_data_t button_change_cmd[4];
-void button_changed(uint32_t button_state, uint32_t has_changed)
+static void button_event_put(uint8_t button, bool pressed, uint32_t timestamp)
 {
-	uint32_t buttons = button_state & has_changed;
+	struct button_event evt = {
+		.timestamp = timestamp,
+		.button = button,
+		.pressed = pressed,
+	};
+
+	if (pressed) {
+		atomic_set_bit(&button_state_live, button);
+	} else {
+		atomic_clear_bit(&button_state_live, button);
+	}
 
-	if (auth_conn) {
-		if (buttons & KEY_PASSKEY_ACCEPT) {
-			num_comp_reply(true);
-		}
+	atomic_inc(&tx_stats.events);
+
+	if (!event_ring_put(&button_events, &evt)) {
+		LOG_WRN("Button event ring full, event dropped");
+	}
+
+	if (pressed && auth_conn &&
+	    ((button == DK_BUTTON1) || (button == DK_BUTTON2))) {
+		atomic_set(&passkey_accept, (button == DK_BUTTON1));
+		k_work_submit(&passkey_work);
+	}
+}
+
+static void button_events_ready(void)
+{
+	k_sem_give(&button_events_sem);
+
+	if (IS_ENABLED(CONFIG_SC_CONN_PARAMS)) {
+		conn_params_activity(NULL);
+	}
+}
+
+#if defined(CONFIG_SC_REMOTE_BUTTON_INPUT)
+/* Called by the button input driver for each edge, from interrupt context */
+static void button_edge(uint8_t button, bool pressed, uint32_t timestamp)
+{
+	if (button >= BUTTON_COUNT) {
+		return;
+	}
+
+	button_event_put(button, pressed, timestamp);
+	button_events_ready();
+}
+#endif
+
+/* DK buttons and scripted input report a whole scan at once */
+void button_changed(uint32_t button_state, uint32_t has_changed)
+{
+	uint32_t timestamp = k_cycle_get_32();
 
-		if (buttons & KEY_PASSKEY_REJECT) {
-			num_comp_reply(false);
+	for (uint8_t button = 0; button < BUTTON_COUNT; button++) {
+		if (has_changed & BIT(button)) {
+			button_event_put(button, button_state & BIT(button),
+					 timestamp);
 		}
-	} 
-	
-	// Forward DK button presses to the BLE NUS service
-	if (BUTTON_CHANGED(DK_BUTTON1)) {
-		button_change_cmd[0].data[0] = '0';
-		button_change_cmd[0].data[1] = BUTTON_PRESSED(DK_BUTTON1) ? '1' : '0';
-		button_change_cmd[0].len = 2;
-		k_fifo_put(&fifo_uart_rx_data, &button_change_cmd[0]);
-	}
-	if (BUTTON_CHANGED(DK_BUTTON2)) {
-		button_change_cmd[1].data[0] = '1';
-		button_change_cmd[1].data[1] = BUTTON_PRESSED(DK_BUTTON2) ? '1' : '0';
-		button_change_cmd[1].len = 2;
-		k_fifo_put(&fifo_uart_rx_data, &button_change_cmd[1]);
-	}
-	if (BUTTON_CHANGED(DK_BUTTON3)) {
-		button_change_cmd[2].data[0] = '2';
-		button_change_cmd[2].data[1] = BUTTON_PRESSED(DK_BUTTON3) ? '1' : '0';
-		button_change_cmd[2].len = 2;
-		k_fifo_put(&fifo_uart_rx_data, &button_change_cmd[2]);
-	}
-	if (BUTTON_CHANGED(DK_BUTTON4)) {
-		button_change_cmd[3].data[0] = '3';
-		button_change_cmd[3].data[1] = BUTTON_PRESSED(DK_BUTTON4) ? '1' : '0';
-		button_change_cmd[3].len = 2;
-		k_fifo_put(&fifo_uart_rx_data, &button_change_cmd[3]);
 	}
+
+	button_events_ready();
 }
 #endif /* CONFIG_BT_NUS_SECURITY_ENABLED */
 
+#if defined(CONFIG_SC_DIAG_SERVICE)
+static void diag_fill(struct diag_buf *buf)
+{
+	struct bt_conn *conn = current_conn_get();
+
+	diag_put_u32(buf, DIAG_TLV_EVENTS, atomic_get(&tx_stats.events));
+	diag_put_u32(buf, DIAG_TLV_EVENTS_SENT, atomic_get(&tx_stats.events_sent));
+	diag_put_u32(buf, DIAG_TLV_FRAMES, atomic_get(&tx_stats.frames));
+	diag_put_u32(buf, DIAG_TLV_TX_FAILED, atomic_get(&tx_stats.drops));
+	diag_put_u32(buf, DIAG_TLV_TX_RETRIES, atomic_get(&tx_stats.retries));
+	diag_put_u32(buf, DIAG_TLV_QUEUE_HWM, event_ring_high_watermark(&button_events));
+	diag_put_u32(buf, DIAG_TLV_QUEUE_OVERFLOWS, event_ring_overflows(&button_events));
+	diag_put_u32(buf, DIAG_TLV_CONNECTS, atomic_get(&tx_stats.connects));
+
+	if (conn) {
+		diag_put_link(buf, 0, conn);
+		bt_conn_unref(conn);
+	}
+}
+#endif
+
 static void configure_gpio(void)
 {
+#if defined(CONFIG_SC_REMOTE_SIM_INPUT)
+	sim_input_start(button_changed);
+#else
 	int err;
 
-#ifdef CONFIG_BT_NUS_SECURITY_ENABLED
+#if defined(CONFIG_SC_REMOTE_BUTTON_INPUT)
+	err = button_input_init(button_edge);
+	if (err) {
+		LOG_ERR("Cannot init buttons (err: %d)", err);
+	}
+#elif defined(CONFIG_BT_NUS_SECURITY_ENABLED)
 	err = dk_buttons_init(button_changed);
 	if (err) {
 		LOG_ERR("Cannot init buttons (err: %d)", err);
 	}
-#endif /* CONFIG_BT_NUS_SECURITY_ENABLED */
+#endif
 
 	err = dk_leds_init();
 	if (err) {
 		LOG_ERR("Cannot init LEDs (err: %d)", err);
 	}
+#endif /* CONFIG_SC_REMOTE_SIM_INPUT */
 }
 
 void main(void)
@@ -313,10 +484,25 @@ void main(void)
 
 	bt_conn_cb_register(&conn_callbacks);
 
+	if (IS_ENABLED(CONFIG_SC_CONN_PARAMS)) {
+		conn_params_init(NULL);
+	}
+
+	if (IS_ENABLED(CONFIG_SC_LINK_SETUP)) {
+		link_setup_init();
+	}
+
 	if (IS_ENABLED(CONFIG_BT_NUS_SECURITY_ENABLED)) {
 		bt_conn_auth_cb_register(&conn_auth_callbacks);
 	}
 
+	if (IS_ENABLED(CONFIG_SC_REMOTE_HOGP)) {
+		err = hogp_init();
+		if (err) {
+			error();
+		}
+	}
+
 	err = bt_enable(NULL);
 	if (err) {
 		error();
@@ -326,6 +512,10 @@ void main(void)
 
 	k_sem_give(&ble_init_ok);
 
+#if defined(CONFIG_SC_DIAG_SERVICE)
+	diag_service_init(diag_fill);
+#endif
+
 	if (IS_ENABLED(CONFIG_SETTINGS)) {
 		settings_load();
 	}
@@ -344,24 +534,197 @@ void main(void)
 	}
 
 	for (;;) {
-		dk_set_led(RUN_STATUS_LED, (++blink_status) % 2);
+		STATUS_LED_SET(RUN_STATUS_LED, (++blink_status) % 2);
 		k_sleep(K_MSEC(RUN_LED_BLINK_INTERVAL));
 	}
 }
 
+static uint16_t frame_max_events(void)
+{
+	struct bt_conn *conn = current_conn_get();
+	uint32_t payload = FRAME_BUF_SIZE;
+
+	if (conn) {
+		payload = MIN(payload, bt_nus_get_mtu(conn));
+		bt_conn_unref(conn);
+	}
+
+	return MIN(SC_PROTO_MAX_EVENTS(payload), FRAME_MAX_EVENTS);
+}
+
+static int frame_send(const uint8_t *frame, uint16_t len)
+{
+	struct bt_conn *conn = current_conn_get();
+	atomic_val_t in_flight;
+	int err;
+
+	if (!conn) {
+		return -ENOTCONN;
+	}
+
+	/* Count it before sending, the completion can come before we return */
+	in_flight = atomic_inc(&tx_stats.in_flight) + 1;
+
+	err = bt_nus_send(conn, frame, len);
+	bt_conn_unref(conn);
+	if (err) {
+		atomic_dec(&tx_stats.in_flight);
+		return err;
+	}
+
+	if (in_flight > atomic_get(&tx_stats.in_flight_max)) {
+		atomic_set(&tx_stats.in_flight_max, in_flight);
+	}
+
+	return 0;
+}
+
+#if defined(CONFIG_SC_REMOTE_STATS_FORWARD)
+static void stats_work_handler(struct k_work *work)
+{
+	static uint8_t frame[SC_PROTO_STATS_MAX_SIZE];
+	struct bt_conn *conn = current_conn_get();
+	struct diag_buf buf = {
+		.data = &frame[1],
+	};
+	int err;
+
+	if (!conn) {
+		return;
+	}
+
+	/* Records past the ATT MTU are left out */
+	buf.size = MIN(sizeof(frame), bt_nus_get_mtu(conn)) - 1;
+	bt_conn_unref(conn);
+
+	k_work_schedule(&stats_work, K_SECONDS(CONFIG_SC_REMOTE_STATS_INTERVAL));
+
+	/* Button events come first, the counters wait for the next round */
+	if (k_sem_take(&tx_credits, K_NO_WAIT)) {
+		return;
+	}
+
+	diag_rssi_update();
+
+	frame[0] = SC_PROTO_STATS_BYTE;
+	diag_put_u32(&buf, DIAG_TLV_UPTIME_MS, k_uptime_get_32());
+	diag_fill(&buf);
+
+	err = frame_send(frame, buf.len + 1);
+	if (err) {
+		k_sem_give(&tx_credits);
+		LOG_DBG("Counters not sent (err %d)", err);
+	}
+}
+#endif
+
 void ble_write_thread(void)
 {
+	static uint8_t frame[FRAME_BUF_SIZE];
+	static struct button_event pending[FRAME_MAX_EVENTS];
+	struct sc_proto_hdr *hdr = (struct sc_proto_hdr *)frame;
+	struct sc_proto_evt *evt = (struct sc_proto_evt *)(frame + SC_PROTO_HDR_SIZE);
+	uint32_t overflows = 0;
+	uint16_t sent_state = 0;
+	uint8_t seq = 0;
+
 	/* Don't go any further until BLE is initialized */
 	k_sem_take(&ble_init_ok, K_FOREVER);
 
+#if defined(CONFIG_SC_REMOTE_HOGP)
+	/* Every edge becomes a HID report of its own, there are no frames */
+	for (;;) {
+		struct button_event buf;
+
+		while (event_ring_get(&button_events, &buf)) {
+			hogp_button_event(&buf);
+		}
+		k_sem_take(&button_events_sem, K_FOREVER);
+	}
+#endif
+
 	for (;;) {
-		/* Wait indefinitely for data to be sent over bluetooth */
-		struct uart_data_t *buf = k_fifo_get(&fifo_uart_rx_data,
-						     K_FOREVER);
+		uint16_t pending_count = 0;
+		uint16_t button_state;
+		uint32_t backoff = CONFIG_SC_REMOTE_TX_RETRY_DELAY_MS;
+		int err;
+
+		/* Wait indefinitely for button events to be sent over bluetooth */
+		if (!event_ring_get(&button_events, &pending[0])) {
+			k_sem_take(&button_events_sem, K_FOREVER);
+			continue;
+		}
+		pending_count = 1;
+
+		/* Wait for a free notification slot. Edges arriving meanwhile
+		 * stay in the ring and are coalesced into this frame.
+		 */
+		k_sem_take(&tx_credits, K_FOREVER);
+
+		for (int attempt = 0;; attempt++) {
+			uint16_t max_events = frame_max_events();
+			uint32_t now = k_uptime_get_32();
+			uint32_t now_cyc = k_cycle_get_32();
+
+			while ((pending_count < max_events) &&
+			       event_ring_get(&button_events, &pending[pending_count])) {
+				pending_count++;
+			}
+
+			/* Ages are refreshed on every attempt */
+			button_state = sent_state;
+			for (uint16_t i = 0; i < pending_count; i++) {
+				uint32_t age = k_cyc_to_ms_floor32(now_cyc - pending[i].timestamp);
+
+				evt[i].button = pending[i].button |
+					(pending[i].pressed ? SC_PROTO_EVT_PRESSED : 0);
+				evt[i].age = MIN(age, SC_PROTO_EVT_AGE_MAX);
+				WRITE_BIT(button_state, pending[i].button, pending[i].pressed);
+			}
+
+			/* Edges were dropped, so the state rebuilt from the events can
+			 * not be trusted. Send the live state and let the dongle resync.
+			 */
+			if (event_ring_overflows(&button_events) != overflows) {
+				overflows = event_ring_overflows(&button_events);
+				button_state = (uint16_t)atomic_get(&button_state_live);
+			}
+
+			hdr->version = SC_PROTO_VERSION_BYTE;
+			hdr->seq = seq;
+			hdr->timestamp = sys_cpu_to_le16((uint16_t)now);
+			hdr->state = sys_cpu_to_le16(button_state);
+
+			err = frame_send(frame, SC_PROTO_FRAME_SIZE(pending_count));
+			if ((err != -ENOMEM) || (attempt >= CONFIG_SC_REMOTE_TX_RETRY_MAX)) {
+				break;
+			}
+
+			/* Out of buffers, back off and let the link drain */
+			atomic_inc(&tx_stats.retries);
+			k_sleep(K_MSEC(backoff));
+			backoff = MIN(backoff * 2, TX_RETRY_DELAY_MAX_MS);
+		}
+
+		/* A dropped frame still uses up its sequence number, so the
+		 * dongle sees the gap
+		 */
+		seq++;
 
-		if (bt_nus_send(NULL, buf->data, buf->len)) {
-			LOG_WRN("Failed to send data over BLE connection");
+		if (err) {
+			k_sem_give(&tx_credits);
+			atomic_inc(&tx_stats.drops);
+			LOG_WRN("Failed to send data over BLE connection (err %d)", err);
+
+			/* Make the next frame carry the live state instead */
+			sent_state = (uint16_t)atomic_get(&button_state_live);
+			continue;
 		}
+
+		sent_state = button_state;
+		atomic_inc(&tx_stats.frames);
+		atomic_add(&tx_stats.events_sent, pending_count);
+		atomic_add(&tx_stats.coalesced, pending_count - 1);
 	}
 }
 
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/hci.h>
+
+#include "sim_input.h"
+
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(sim_input, CONFIG_SC_LOG_LEVEL);
+
+#define SIM_BUTTONS 4
+#define SIM_BUTTONS_MSK BIT_MASK(SIM_BUTTONS)
+
+#define TAP_COUNT 20
+#define TAP_HOLD_MS 50
+#define TAP_GAP_MS 100
+#define MASH_EDGES 2000
+#define CHORD_BUTTONS (BIT(2) | BIT(3))
+/* Quiet time after each scenario, so the dongle's once a second counters
+ * can be split per scenario by scripts/bsim_check.py
+ */
+#define SCENARIO_GAP_MS 2000
+
+static K_SEM_DEFINE(sim_start, 0, 1);
+
+static sim_input_handler_t handler;
+static uint32_t button_state;
+static uint32_t edges;
+
+static void buttons_set(uint32_t state)
+{
+	uint32_t changed = state ^ button_state;
+
+	if (!changed) {
+		return;
+	}
+
+	button_state = state;
+	edges += __builtin_popcount(changed);
+	handler(state, changed);
+}
+
+static void tap(uint32_t buttons)
+{
+	buttons_set(button_state | buttons);
+	k_sleep(K_MSEC(TAP_HOLD_MS));
+	buttons_set(button_state & ~buttons);
+	k_sleep(K_MSEC(TAP_GAP_MS));
+}
+
+static void conn_get_first(struct bt_conn *conn, void *data)
+{
+	struct bt_conn **first = data;
+
+	if (!*first) {
+		*first = bt_conn_ref(conn);
+	}
+}
+
+/* Connected, with security set up so the dongle has subscribed */
+static bool link_ready(void)
+{
+	struct bt_conn *conn = NULL;
+	bool ready;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, conn_get_first, &conn);
+	if (!conn) {
+		return false;
+	}
+
+	ready = bt_conn_get_security(conn) >= BT_SECURITY_L2;
+	bt_conn_unref(conn);
+	return ready;
+}
+
+static uint32_t link_wait(void)
+{
+	uint32_t start = k_uptime_get_32();
+
+	while (!link_ready()) {
+		k_sleep(K_MSEC(10));
+	}
+	/* Leave time for the dongle to subscribe to notifications */
+	k_sleep(K_SECONDS(1));
+
+	return k_uptime_get_32() - start;
+}
+
+static void link_drop(struct bt_conn *conn, void *data)
+{
+	bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+}
+
+static void scenario_taps(void)
+{
+	for (int i = 0; i < TAP_COUNT; i++) {
+		tap(BIT(i % SIM_BUTTONS));
+	}
+}
+
+/* Random edges on all buttons as fast as a human could never go */
+static void scenario_mash(void)
+{
+	uint32_t lfsr = 0xACE1u;
+
+	for (int i = 0; i < MASH_EDGES; i++) {
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+		buttons_set(button_state ^ BIT(lfsr % SIM_BUTTONS));
+		k_sleep(K_MSEC(1 + (lfsr >> 8) % 4));
+	}
+	buttons_set(0);
+	k_sleep(K_MSEC(TAP_GAP_MS));
+}
+
+static void scenario_chords(void)
+{
+	for (int i = 0; i < TAP_COUNT; i++) {
+		tap(CHORD_BUTTONS);
+	}
+}
+
+/* Keep tapping through a disconnection, the dongle must not be left with stuck keys */
+static void scenario_link_drop(void)
+{
+	uint32_t reconnect_ms;
+
+	for (int i = 0; i < TAP_COUNT / 2; i++) {
+		tap(BIT(i % SIM_BUTTONS));
+	}
+
+	buttons_set(BIT(3));
+	bt_conn_foreach(BT_CONN_TYPE_LE, link_drop, NULL);
+	buttons_set(0);
+
+	reconnect_ms = link_wait();
+	LOG_INF("sim: link back after %u ms", reconnect_ms);
+
+	for (int i = 0; i < TAP_COUNT / 2; i++) {
+		tap(BIT(i % SIM_BUTTONS));
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*run)(void);
+} scenarios[] = {
+	{"taps", scenario_taps},
+	{"mash", scenario_mash},
+	{"chords", scenario_chords},
+	{"link_drop", scenario_link_drop},
+};
+
+static void sim_input_thread(void)
+{
+	uint32_t total = 0;
+
+	k_sem_take(&sim_start, K_FOREVER);
+
+	LOG_INF("sim: link up after %u ms", link_wait());
+
+	for (int i = 0; i < ARRAY_SIZE(scenarios); i++) {
+		uint32_t start = k_uptime_get_32();
+
+		edges = 0;
+		scenarios[i].run();
+		total += edges;
+
+		LOG_INF("sim: scenario %s: %u edges in %u ms", scenarios[i].name,
+			edges, k_uptime_get_32() - start);
+		k_sleep(K_MSEC(SCENARIO_GAP_MS));
+	}
+
+	LOG_INF("sim: done, %u edges", total);
+}
+
+K_THREAD_DEFINE(sim_input_thread_id, 1024, sim_input_thread, NULL, NULL, NULL,
+		7, 0, 0);
+
+void sim_input_start(sim_input_handler_t input_handler)
+{
+	handler = input_handler;
+	k_sem_give(&sim_start);
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Scripted button input for simulated boards
+ */
+
+#ifndef SIM_INPUT_H_
+#define SIM_INPUT_H_
+
+#include <zephyr/types.h>
+
+/* Same signature as the DK buttons handler */
+typedef void (*sim_input_handler_t)(uint32_t button_state, uint32_t has_changed);
+
+/* Play the scripted scenarios once a central has connected */
+void sim_input_start(sim_input_handler_t handler);
+
+#endif /* SIM_INPUT_H_ */
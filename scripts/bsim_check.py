@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2022 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Check the logs of a BabbleSim run made by bsim_run.sh. For every scenario
+# played by the remote, the HID reports captured and the frames lost on the
+# dongle are compared with the button edges the remote sent, and the script
+# exits with 1 if any of them is out of bounds.
+#
+# Both devices start at simulated time 0, so the log timestamps line up. The
+# remote pauses between scenarios, and the dongle logs its totals since boot
+# once a second, so the last dongle summary before the next scenario starts
+# holds everything the scenario caused.
+
+import argparse
+import re
+import sys
+
+# Reports per edge, and frames the dongle may report lost. Each tap edge is a
+# frame and a report of its own, a chord edge moves two buttons in one report,
+# mashing packs several edges in a frame, and the link drop may lose the
+# edges made while disconnected.
+EXPECTED = {
+    "taps": {"ratio": (1.0, 1.0), "lost": 0},
+    "mash": {"ratio": (0.25, 1.0), "lost": 0},
+    "chords": {"ratio": (0.5, 0.5), "lost": 0},
+    "link_drop": {"ratio": (0.9, 1.0), "lost": 1},
+}
+
+# Quiet time after each scenario, SCENARIO_GAP_MS in sim_input.c
+SCENARIO_GAP_S = 2.0
+
+TIMESTAMP = re.compile(r"\[(\d+):(\d+):(\d+)\.(\d+),(\d+)\]")
+SCENARIO = re.compile(r"sim: scenario (\w+): (\d+) edges in (\d+) ms")
+DONE = re.compile(r"sim: done, (\d+) edges")
+HID = re.compile(r"sim: hid (\d+) reports")
+RX = re.compile(r"sim: rx (\d+) frames, (\d+) events, (\d+) lost, (\d+) resyncs")
+
+
+def timestamp(line):
+    m = TIMESTAMP.search(line)
+    if not m:
+        return None
+    h, mi, s, ms, us = (int(g) for g in m.groups())
+    return h * 3600 + mi * 60 + s + ms / 1e3 + us / 1e6
+
+
+def parse(path, patterns):
+    found = {name: [] for name in patterns}
+    with open(path, errors="replace") as f:
+        for line in f:
+            t = timestamp(line)
+            if t is None:
+                continue
+            for name, pattern in patterns.items():
+                m = pattern.search(line)
+                if m:
+                    found[name].append((t, [int(g) if g.isdigit() else g for g in m.groups()]))
+    return found
+
+
+def last_before(samples, t):
+    """Counters of the last summary logged before t, zeros before the first one"""
+    values = None
+    for sample_t, sample in samples:
+        if sample_t >= t:
+            break
+        values = sample
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check a BabbleSim run of the remote and the dongle")
+    parser.add_argument("remote_log")
+    parser.add_argument("dongle_log")
+    parser.add_argument("--tolerance", type=float, default=0.05,
+                        help="slack on the reports per edge bounds (default 0.05)")
+    args = parser.parse_args()
+
+    remote = parse(args.remote_log, {"scenario": SCENARIO, "done": DONE})
+    dongle = parse(args.dongle_log, {"hid": HID, "rx": RX})
+
+    failures = []
+    if not remote["done"]:
+        failures.append("remote did not finish its scenarios")
+
+    seen = [sample[0] for _, sample in remote["scenario"]]
+    for name in EXPECTED:
+        if name not in seen:
+            failures.append(f"scenario {name} missing from the remote log")
+
+    print(f"{'scenario':<10} {'edges':>6} {'reports':>8} {'per edge':>9} {'events':>7} "
+          f"{'lost':>5} {'resyncs':>8}  result")
+
+    for end, (name, edges, duration_ms) in remote["scenario"]:
+        start = end - duration_ms / 1e3
+        cut = end + SCENARIO_GAP_S
+
+        hid_start = last_before(dongle["hid"], start) or [0]
+        hid_end = last_before(dongle["hid"], cut)
+        rx_start = last_before(dongle["rx"], start) or [0, 0, 0, 0]
+        rx_end = last_before(dongle["rx"], cut)
+
+        if hid_end is None or rx_end is None:
+            failures.append(f"{name}: no dongle summary after the scenario")
+            continue
+
+        reports = hid_end[0] - hid_start[0]
+        events = rx_end[1] - rx_start[1]
+        lost = rx_end[2] - rx_start[2]
+        resyncs = rx_end[3] - rx_start[3]
+        ratio = reports / edges if edges else 0.0
+
+        problems = []
+        expected = EXPECTED.get(name)
+        if expected:
+            low, high = expected["ratio"]
+            if not (low - args.tolerance) <= ratio <= (high + args.tolerance):
+                problems.append(f"{ratio:.2f} reports per edge, expected {low:.2f} - {high:.2f}")
+            if lost > expected["lost"]:
+                problems.append(f"{lost} frames lost, at most {expected['lost']} expected")
+        failures.extend(f"{name}: {p}" for p in problems)
+
+        print(f"{name:<10} {edges:>6} {reports:>8} {ratio:>9.2f} {events:>7} {lost:>5} "
+              f"{resyncs:>8}  {'FAIL' if problems else 'ok'}")
+
+    for failure in failures:
+        print(f"FAIL {failure}", file=sys.stderr)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
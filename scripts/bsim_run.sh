@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2022 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Build the remote and the dongle for the simulated nrf52_bsim board and run
+# them together in one BabbleSim radio environment. The remote plays its
+# scripted scenarios, the summaries of both sides are printed at the end, and
+# bsim_check.py checks every scenario. The exit code is non-zero if any of
+# them is out of bounds.
+#
+# Needs a west workspace with the nRF Connect SDK, and BabbleSim with
+# BSIM_OUT_PATH and BSIM_COMPONENTS_PATH set.
+
+set -eu
+
+: "${BSIM_OUT_PATH:?Set BSIM_OUT_PATH to the BabbleSim output folder}"
+: "${BSIM_COMPONENTS_PATH:?Set BSIM_COMPONENTS_PATH to the BabbleSim components folder}"
+
+REPO_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-${REPO_DIR}/build_bsim}
+SIM_ID=${SIM_ID:-sc_remote_demo}
+# Simulated time, long enough for every scenario including the link drop
+SIM_LENGTH_US=${SIM_LENGTH_US:-90000000}
+
+west build -b nrf52_bsim -d "${BUILD_DIR}/remote" "${REPO_DIR}/sc-remote"
+west build -b nrf52_bsim -d "${BUILD_DIR}/dongle" "${REPO_DIR}/sc-remote-usb-dongle"
+
+cd "${BSIM_OUT_PATH}/bin"
+
+./bs_2G4_phy_v1 -s="${SIM_ID}" -D=2 -sim_length="${SIM_LENGTH_US}" > /dev/null &
+"${BUILD_DIR}/remote/zephyr/zephyr.exe" -s="${SIM_ID}" -d=0 > "${BUILD_DIR}/remote.log" 2>&1 &
+"${BUILD_DIR}/dongle/zephyr/zephyr.exe" -s="${SIM_ID}" -d=1 > "${BUILD_DIR}/dongle.log" 2>&1 &
+
+wait
+
+echo "Remote:"
+grep "sim:" "${BUILD_DIR}/remote.log" || true
+echo "Dongle:"
+grep -E "Remote [0-9]+:|(remote|link|decode|queue|usb|total) +n=" "${BUILD_DIR}/dongle.log" | tail -n 20 || true
+grep "sim:" "${BUILD_DIR}/dongle.log" | tail -n 2 || true
+
+echo "Check:"
+python3 "${REPO_DIR}/scripts/bsim_check.py" "${BUILD_DIR}/remote.log" "${BUILD_DIR}/dongle.log"
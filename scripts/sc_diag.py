@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2022 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Read the diagnostics characteristic of a remote or a dongle and print its
+# records. The record types match common/include/diag_service.h.
+#
+# Needs Python 3.7 or later and bleak (pip install bleak).
+
+import argparse
+import asyncio
+import struct
+import sys
+
+from bleak import BleakClient, BleakScanner
+
+DIAG_STATS_UUID = "5a3e0c11-7b1f-4d62-8f0a-1c9b2e6d4f80"
+
+PHY_NAMES = {1: "1M", 2: "2M", 4: "Coded"}
+
+# Type: (name, struct format)
+TLV_TYPES = {
+    0x01: ("uptime_ms", "<I"),
+    0x10: ("events", "<I"),
+    0x11: ("events_sent", "<I"),
+    0x12: ("frames", "<I"),
+    0x13: ("tx_failed", "<I"),
+    0x14: ("tx_retries", "<I"),
+    0x15: ("frames_lost", "<I"),
+    0x16: ("resyncs", "<I"),
+    0x20: ("queue_hwm", "<I"),
+    0x21: ("queue_overflows", "<I"),
+    0x22: ("hid_reports", "<I"),
+    0x23: ("hid_ep_busy", "<I"),
+    0x24: ("hid_dropped", "<I"),
+    0x25: ("hid_ep_timeouts", "<I"),
+    0x30: ("connects", "<I"),
+    0x40: ("link", "<B"),
+    0x41: ("rssi", "<b"),
+    0x42: ("conn_interval", "<H"),
+    0x43: ("phy", "<BB"),
+    0x44: ("mtu", "<H"),
+    0x45: ("data_len", "<HH"),
+}
+
+# The records a remote sends to the dongle about itself, nested in one record
+TLV_REMOTE = 0x50
+
+
+def format_value(name, values):
+    if name == "rssi":
+        return "unknown" if values[0] == 127 else f"{values[0]} dBm"
+    if name == "conn_interval":
+        return f"{values[0] * 1.25:g} ms"
+    if name == "phy":
+        return "tx {} rx {}".format(*(PHY_NAMES.get(v, v) for v in values))
+    if name == "data_len":
+        return "tx {} rx {}".format(*values)
+    return str(values[0])
+
+
+def decode(data, indent=""):
+    lines = []
+    i = 0
+
+    while i + 2 <= len(data):
+        tlv_type, length = data[i], data[i + 1]
+        payload = data[i + 2:i + 2 + length]
+        i += 2 + length
+
+        if len(payload) < length:
+            lines.append(f"{indent}truncated record")
+            break
+
+        if tlv_type == TLV_REMOTE:
+            lines.append(f"{indent}  as seen by the remote:")
+            lines.append(decode(payload, indent + "    "))
+            continue
+
+        name, fmt = TLV_TYPES.get(tlv_type, (None, None))
+        if name is None or struct.calcsize(fmt) != length:
+            lines.append(f"{indent}type 0x{tlv_type:02x}: {payload.hex()}")
+            continue
+
+        values = struct.unpack(fmt, payload)
+        if name == "link":
+            lines.append(f"{indent}link {values[0]}:")
+        else:
+            lines.append(f"{indent}  {name}: {format_value(name, values)}")
+
+    return "\n".join(lines)
+
+
+def print_value(data):
+    print(decode(bytes(data)))
+    print()
+
+
+async def find_device(target, timeout):
+    if ":" in target:
+        device = await BleakScanner.find_device_by_address(target, timeout=timeout)
+    else:
+        device = await BleakScanner.find_device_by_filter(
+            lambda d, ad: (d.name or ad.local_name) == target, timeout=timeout)
+    if device is None:
+        sys.exit(f"{target} not found")
+    return device
+
+
+async def run(args):
+    device = await find_device(args.device, args.timeout)
+
+    async with BleakClient(device) as client:
+        if not args.follow:
+            print_value(await client.read_gatt_char(DIAG_STATS_UUID))
+            return
+
+        await client.start_notify(DIAG_STATS_UUID, lambda _, data: print_value(data))
+        try:
+            while client.is_connected:
+                await asyncio.sleep(1)
+        finally:
+            if client.is_connected:
+                await client.stop_notify(DIAG_STATS_UUID)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Read the diagnostics service of a remote or dongle")
+    parser.add_argument("device", help="advertised name or Bluetooth address")
+    parser.add_argument("-f", "--follow", action="store_true",
+                        help="print every notification until interrupted")
+    parser.add_argument("-t", "--timeout", type=float, default=10.0,
+                        help="scan timeout in seconds")
+    args = parser.parse_args()
+
+    try:
+        asyncio.run(run(args))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
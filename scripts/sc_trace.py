@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2022 Nordic Semiconductor
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Decode the binary event trace of the dongle, built with overlay-shell.conf.
+# Open the trace port with this script, then run "sc trace on" in the shell
+# on the other port. The record types match app_trace.h.
+#
+# Needs pyserial (pip install pyserial).
+
+import argparse
+import struct
+import sys
+
+import serial
+
+RECORD = struct.Struct("<BBHI")
+START = 0
+REPORT_IDS = {1: "kbd", 2: "cons"}
+
+
+def button_edge(arg16):
+    return "button {} {}".format(arg16 & 0x7f, "pressed" if arg16 & 0x80 else "released")
+
+
+TYPES = {
+    1: ("frame_rx", lambda a8, a16: f"remote {a8}, {a16} bytes"),
+    2: ("remote_event", lambda a8, a16: f"remote {a8}, {button_edge(a16)}, age {a16 >> 8} ms"),
+    3: ("local_event", lambda a8, a16: button_edge(a16)),
+    4: ("report_direct", lambda a8, a16: REPORT_IDS.get(a8, a8)),
+    5: ("report_queued", lambda a8, a16: f"{REPORT_IDS.get(a8, a8)}, depth {a16}"),
+    6: ("report_submitted", lambda a8, a16: REPORT_IDS.get(a8, a8)),
+    7: ("report_done", lambda a8, a16: ("kbd", "cons")[a8] if a8 < 2 else a8),
+    8: ("report_dropped", lambda a8, a16: REPORT_IDS.get(a8, a8)),
+    9: ("disconnected", lambda a8, a16: f"remote {a8}"),
+}
+
+
+def read_exact(port, size):
+    data = b""
+    while len(data) < size:
+        data += port.read(size - len(data))
+    return data
+
+
+def sync(port):
+    # The start record is 00 00 08 00 followed by the cycle counter rate
+    window = b""
+    while window != bytes([START, 0, RECORD.size, 0]):
+        window = (window + port.read(1))[-4:]
+    return struct.unpack("<I", read_exact(port, 4))[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the dongle's event trace")
+    parser.add_argument("port", help="serial port of the trace, the second CDC ACM port")
+    parser.add_argument("-o", "--output", help="also write the raw records to this file")
+    args = parser.parse_args()
+
+    raw = open(args.output, "wb") if args.output else None
+
+    with serial.Serial(args.port, timeout=None) as port:
+        print("Waiting for \"sc trace on\"", file=sys.stderr)
+        hz = sync(port)
+        print(f"Trace started, cycle counter at {hz} Hz", file=sys.stderr)
+
+        start = last = None
+        elapsed = 0
+        try:
+            while True:
+                data = read_exact(port, RECORD.size)
+                if raw:
+                    raw.write(data)
+                kind, arg8, arg16, cycles = RECORD.unpack(data)
+
+                if kind == START:
+                    hz = cycles
+                    start = last = None
+                    elapsed = 0
+                    continue
+
+                # The counter is 32 bits and wraps
+                if start is None:
+                    start = last = cycles
+                elapsed += (cycles - last) & 0xffffffff
+                last = cycles
+
+                name, describe = TYPES.get(kind, (f"type {kind}", lambda a8, a16: f"{a8} {a16}"))
+                print(f"{elapsed * 1e6 / hz:12.1f} us  {name:<16} {describe(arg8, arg16)}")
+        except KeyboardInterrupt:
+            pass
+        finally:
+            if raw:
+                raw.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <ztest.h>
+#include <errno.h>
+#include <string.h>
+
+#include "app_kbd_state.h"
+#include "app_latency.h"
+#include "app_usb_hid.h"
+
+#define REMOTE_0	APP_KBD_SOURCE_REMOTE(0)
+#define REMOTE_1	APP_KBD_SOURCE_REMOTE(1)
+
+// Stand-in for the USB HID side, keeps the last report sent
+static struct {
+	int count;
+	uint8_t source;
+	uint8_t flags;
+	uint32_t key_bitmap[APP_USB_HID_KEY_BITMAP_WORDS];
+	int ret;
+} m_report;
+
+int app_usb_hid_send_kbd_state(uint8_t source, uint8_t flags, const uint32_t *key_bitmap)
+{
+	if (m_report.ret) {
+		return m_report.ret;
+	}
+
+	m_report.count++;
+	m_report.source = source;
+	m_report.flags = flags;
+	memcpy(m_report.key_bitmap, key_bitmap, sizeof(m_report.key_bitmap));
+	return 0;
+}
+
+static bool report_holds(uint8_t key)
+{
+	return m_report.key_bitmap[key / 32] & BIT(key % 32);
+}
+
+static int report_key_count(void)
+{
+	int count = 0;
+
+	for (int i = 0; i < APP_USB_HID_KEY_BITMAP_WORDS; i++) {
+		count += __builtin_popcount(m_report.key_bitmap[i]);
+	}
+	return count;
+}
+
+static int press(uint8_t source, uint8_t slot, uint8_t modifiers, uint8_t key)
+{
+	return app_kbd_state_press(source, slot,
+				   (struct app_kbd_action){.modifiers = modifiers, .key = key});
+}
+
+// Release everything, and start counting reports from zero
+static void setup(void)
+{
+	m_report.ret = 0;
+	for (uint8_t source = 0; source < APP_KBD_SOURCE_COUNT; source++) {
+		app_kbd_state_release_all(source);
+		app_kbd_state_commit(source);
+	}
+	memset(&m_report, 0, sizeof(m_report));
+}
+
+static void test_merge(void)
+{
+	zassert_ok(press(REMOTE_0, 0, 0, KEY_A), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_equal(m_report.count, 1, NULL);
+	zassert_equal(m_report.source, REMOTE_0, NULL);
+
+	zassert_ok(press(REMOTE_1, 3, HID_KBD_REP_FLAG_LEFT_SHIFT, KEY_B), NULL);
+	zassert_ok(press(APP_KBD_SOURCE_LOCAL, 0, HID_KBD_REP_FLAG_LEFT_CTRL, 0), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_1), NULL);
+	zassert_ok(app_kbd_state_commit(APP_KBD_SOURCE_LOCAL), NULL);
+
+	// Keys and modifiers of every source are in the same report
+	zassert_equal(m_report.count, 3, NULL);
+	zassert_equal(m_report.source, APP_KBD_SOURCE_LOCAL, NULL);
+	zassert_equal(m_report.flags,
+		      HID_KBD_REP_FLAG_LEFT_SHIFT | HID_KBD_REP_FLAG_LEFT_CTRL, NULL);
+	zassert_true(report_holds(KEY_A), NULL);
+	zassert_true(report_holds(KEY_B), NULL);
+	zassert_equal(report_key_count(), 2, NULL);
+
+	// Releasing one source leaves the keys of the others
+	app_kbd_state_release_all(REMOTE_0);
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_equal(m_report.count, 4, NULL);
+	zassert_false(report_holds(KEY_A), NULL);
+	zassert_true(report_holds(KEY_B), NULL);
+}
+
+static void test_pending_until_commit(void)
+{
+	zassert_ok(press(REMOTE_0, 0, 0, KEY_A), NULL);
+	zassert_ok(press(REMOTE_0, 1, 0, KEY_B), NULL);
+	zassert_equal(m_report.count, 0, "Report sent before the commit");
+
+	// Both edges of the chord end up in one report
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_equal(m_report.count, 1, NULL);
+	zassert_equal(report_key_count(), 2, NULL);
+
+	// Pending edges of another source are not published along
+	zassert_ok(press(REMOTE_1, 0, 0, KEY_C), NULL);
+	zassert_ok(app_kbd_state_release(REMOTE_0, 1), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_equal(m_report.count, 2, NULL);
+	zassert_false(report_holds(KEY_C), NULL);
+	zassert_false(report_holds(KEY_B), NULL);
+}
+
+static void test_changes_only(void)
+{
+	// The same key held by two sources
+	zassert_ok(press(REMOTE_0, 0, 0, KEY_A), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_ok(press(REMOTE_1, 2, 0, KEY_A), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_1), NULL);
+	zassert_equal(m_report.count, 1, "Unchanged state sent again");
+
+	// Still held by the other source
+	zassert_ok(app_kbd_state_release(REMOTE_0, 0), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_equal(m_report.count, 1, NULL);
+
+	zassert_ok(app_kbd_state_release(REMOTE_1, 2), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_1), NULL);
+	zassert_equal(m_report.count, 2, NULL);
+	zassert_equal(report_key_count(), 0, NULL);
+}
+
+static void test_refresh(void)
+{
+	zassert_ok(press(REMOTE_0, 0, 0, KEY_A), NULL);
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+
+	// Sent even though nothing changed, and not timed as an event
+	zassert_ok(app_kbd_state_refresh(), NULL);
+	zassert_equal(m_report.count, 2, NULL);
+	zassert_equal(m_report.source, APP_LATENCY_SOURCE_NONE, NULL);
+	zassert_true(report_holds(KEY_A), NULL);
+}
+
+static void test_send_error(void)
+{
+	m_report.ret = -ENOMEM;
+	zassert_ok(press(REMOTE_0, 0, 0, KEY_A), NULL);
+	zassert_equal(app_kbd_state_commit(REMOTE_0), -ENOMEM, NULL);
+
+	// The state the host has not seen is sent with the next commit
+	m_report.ret = 0;
+	zassert_ok(app_kbd_state_commit(REMOTE_0), NULL);
+	zassert_equal(m_report.count, 1, NULL);
+	zassert_true(report_holds(KEY_A), NULL);
+}
+
+static void test_invalid(void)
+{
+	zassert_equal(press(APP_KBD_SOURCE_COUNT, 0, 0, KEY_A), -EINVAL, NULL);
+	zassert_equal(press(REMOTE_0, APP_KBD_SLOT_COUNT, 0, KEY_A), -EINVAL, NULL);
+	zassert_equal(app_kbd_state_commit(APP_KBD_SOURCE_COUNT), -EINVAL, NULL);
+	zassert_equal(m_report.count, 0, NULL);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(kbd_state,
+			 ztest_unit_test_setup_teardown(test_merge, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_pending_until_commit, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_changes_only, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_refresh, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_send_error, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_invalid, setup, unit_test_noop));
+	ztest_run_test_suite(kbd_state);
+}
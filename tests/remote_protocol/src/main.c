@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <ztest.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/byteorder.h>
+
+#include <sc_protocol.h>
+
+#include "app_remote_protocol.h"
+
+#define MAX_EVENTS 16
+
+struct edge {
+	uint8_t button;
+	bool pressed;
+	uint8_t age_ms;
+};
+
+static struct edge m_edges[MAX_EVENTS];
+static int m_edge_count;
+
+static struct app_remote_proto_rx m_rx;
+
+static void on_event(struct app_remote_proto_rx *rx, uint8_t button,
+		     bool pressed, uint8_t age_ms)
+{
+	zassert_equal_ptr(rx, &m_rx, "Event for another remote");
+	zassert_true(m_edge_count < MAX_EVENTS, "Too many events");
+
+	m_edges[m_edge_count++] = (struct edge){button, pressed, age_ms};
+}
+
+static void setup(void)
+{
+	memset(&m_rx, 0, sizeof(m_rx));
+	m_rx.on_event = on_event;
+	m_edge_count = 0;
+}
+
+// Frame with the given events, each a button number with SC_PROTO_EVT_PRESSED or not
+static uint16_t frame_build(uint8_t *frame, uint8_t seq, uint16_t state,
+			    const uint8_t *buttons, uint16_t count)
+{
+	struct sc_proto_hdr *hdr = (struct sc_proto_hdr *)frame;
+	struct sc_proto_evt *evt = (struct sc_proto_evt *)(frame + SC_PROTO_HDR_SIZE);
+
+	hdr->version = SC_PROTO_VERSION_BYTE;
+	hdr->seq = seq;
+	hdr->timestamp = sys_cpu_to_le16(1000);
+	hdr->state = sys_cpu_to_le16(state);
+
+	for (uint16_t i = 0; i < count; i++) {
+		evt[i].button = buttons[i];
+		evt[i].age = i;
+	}
+
+	return SC_PROTO_FRAME_SIZE(count);
+}
+
+static int frame_send(uint8_t seq, uint16_t state, const uint8_t *buttons, uint16_t count)
+{
+	uint8_t frame[SC_PROTO_FRAME_SIZE(MAX_EVENTS)];
+	uint16_t len = frame_build(frame, seq, state, buttons, count);
+
+	return app_remote_proto_decode(&m_rx, frame, len);
+}
+
+static int legacy_send(const char *frame)
+{
+	return app_remote_proto_decode(&m_rx, (const uint8_t *)frame, SC_PROTO_LEGACY_SIZE);
+}
+
+static void assert_edge(int index, uint8_t button, bool pressed)
+{
+	zassert_true(index < m_edge_count, "Event %d missing", index);
+	zassert_equal(m_edges[index].button, button, "Event %d: button %u",
+		      index, m_edges[index].button);
+	zassert_equal(m_edges[index].pressed, pressed, "Event %d: wrong state", index);
+}
+
+static void test_legacy(void)
+{
+	zassert_ok(legacy_send("21"), NULL);
+	zassert_ok(legacy_send("20"), NULL);
+
+	zassert_equal(m_edge_count, 2, NULL);
+	assert_edge(0, 2, true);
+	assert_edge(1, 2, false);
+	zassert_equal(m_edges[0].age_ms, 0, NULL);
+
+	// Only buttons '0' - '3' exist in the legacy format
+	zassert_equal(legacy_send("41"), -EINVAL, NULL);
+	zassert_equal(m_edge_count, 2, NULL);
+	zassert_equal(m_rx.stats.malformed, 1, NULL);
+
+	// Legacy frames carry no sequence number
+	zassert_equal(m_rx.stats.frames, 0, NULL);
+	zassert_false(m_rx.synced, NULL);
+}
+
+static void test_malformed(void)
+{
+	uint8_t frame[SC_PROTO_FRAME_SIZE(2)];
+	uint8_t buttons[] = {0 | SC_PROTO_EVT_PRESSED, 1 | SC_PROTO_EVT_PRESSED};
+	uint16_t len = frame_build(frame, 0, 0x0003, buttons, ARRAY_SIZE(buttons));
+
+	// Shorter than a header, and a partial event record
+	zassert_equal(app_remote_proto_decode(&m_rx, frame, SC_PROTO_HDR_SIZE - 1),
+		      -EINVAL, NULL);
+	zassert_equal(app_remote_proto_decode(&m_rx, frame, len - 1), -EINVAL, NULL);
+
+	// Unknown version
+	frame[0] = SC_PROTO_VERSION_BYTE + 1;
+	zassert_equal(app_remote_proto_decode(&m_rx, frame, len), -EINVAL, NULL);
+
+	zassert_equal(m_rx.stats.malformed, 3, NULL);
+	zassert_equal(m_rx.stats.frames, 0, NULL);
+	zassert_equal(m_edge_count, 0, "Malformed frame decoded");
+	zassert_false(m_rx.synced, NULL);
+
+	// A header alone is a valid frame without events
+	frame[0] = SC_PROTO_VERSION_BYTE;
+	zassert_ok(app_remote_proto_decode(&m_rx, frame, SC_PROTO_HDR_SIZE), NULL);
+	zassert_equal(m_rx.stats.frames, 1, NULL);
+}
+
+static void test_events(void)
+{
+	uint8_t buttons[] = {0 | SC_PROTO_EVT_PRESSED, 5 | SC_PROTO_EVT_PRESSED, 0};
+
+	zassert_ok(frame_send(0, BIT(5), buttons, ARRAY_SIZE(buttons)), NULL);
+
+	zassert_equal(m_edge_count, 3, NULL);
+	assert_edge(0, 0, true);
+	assert_edge(1, 5, true);
+	assert_edge(2, 0, false);
+	zassert_equal(m_edges[1].age_ms, 1, "Age not passed on");
+	zassert_equal(m_rx.state, BIT(5), NULL);
+	zassert_equal(m_rx.stats.events, 3, NULL);
+	zassert_equal(m_rx.stats.resyncs, 0, NULL);
+}
+
+static void test_seq_gap(void)
+{
+	// The first frame after a reset has nothing to compare with
+	zassert_ok(frame_send(200, 0, NULL, 0), NULL);
+	zassert_ok(frame_send(201, 0, NULL, 0), NULL);
+	zassert_equal(m_rx.stats.lost_frames, 0, NULL);
+
+	zassert_ok(frame_send(204, 0, NULL, 0), NULL);
+	zassert_equal(m_rx.stats.lost_frames, 2, NULL);
+
+	// Across the wrap of the 8 bit sequence number
+	zassert_ok(frame_send(254, 0, NULL, 0), NULL);
+	zassert_ok(frame_send(1, 0, NULL, 0), NULL);
+	zassert_equal(m_rx.stats.lost_frames, 2 + 49 + 2, NULL);
+	zassert_equal(m_rx.stats.frames, 5, NULL);
+
+	// After a reset, the sequence starts over without a gap
+	app_remote_proto_reset(&m_rx);
+	zassert_ok(frame_send(100, 0, NULL, 0), NULL);
+	zassert_equal(m_rx.stats.lost_frames, 2 + 49 + 2, NULL);
+}
+
+static void test_resync(void)
+{
+	uint8_t press_0[] = {0 | SC_PROTO_EVT_PRESSED};
+
+	// The first frame takes the state as is, without counting a resync
+	zassert_ok(frame_send(0, BIT(0) | BIT(3), press_0, 1), NULL);
+	zassert_equal(m_edge_count, 2, NULL);
+	assert_edge(0, 0, true);
+	assert_edge(1, 3, true);
+	zassert_equal(m_edges[1].age_ms, SC_PROTO_EVT_AGE_MAX, NULL);
+	zassert_equal(m_rx.stats.resyncs, 0, NULL);
+
+	// The frame releasing button 3 was lost, the next one only holds button 0
+	zassert_ok(frame_send(2, BIT(0), NULL, 0), NULL);
+	zassert_equal(m_edge_count, 3, NULL);
+	assert_edge(2, 3, false);
+	zassert_equal(m_rx.state, BIT(0), NULL);
+	zassert_equal(m_rx.stats.resyncs, 1, NULL);
+	zassert_equal(m_rx.stats.lost_frames, 1, NULL);
+}
+
+static void test_duplicate_edges(void)
+{
+	uint8_t press_twice[] = {2 | SC_PROTO_EVT_PRESSED, 2 | SC_PROTO_EVT_PRESSED};
+	uint8_t release[] = {2};
+
+	zassert_ok(frame_send(0, BIT(2), press_twice, ARRAY_SIZE(press_twice)), NULL);
+	zassert_equal(m_edge_count, 1, NULL);
+
+	// A release of a button that is not held changes nothing
+	zassert_ok(frame_send(1, 0, release, 1), NULL);
+	zassert_ok(frame_send(2, 0, release, 1), NULL);
+	zassert_equal(m_edge_count, 2, NULL);
+	assert_edge(1, 2, false);
+	zassert_equal(m_rx.stats.events, 2, NULL);
+	zassert_equal(m_rx.stats.resyncs, 0, NULL);
+}
+
+static void test_reset(void)
+{
+	uint8_t buttons[] = {1 | SC_PROTO_EVT_PRESSED, 7 | SC_PROTO_EVT_PRESSED};
+
+	zassert_ok(frame_send(0, BIT(1) | BIT(7), buttons, ARRAY_SIZE(buttons)), NULL);
+	m_edge_count = 0;
+
+	// Every held button is released
+	app_remote_proto_reset(&m_rx);
+	zassert_equal(m_edge_count, 2, NULL);
+	assert_edge(0, 1, false);
+	assert_edge(1, 7, false);
+	zassert_equal(m_rx.state, 0, NULL);
+	zassert_false(m_rx.synced, NULL);
+}
+
+static void test_stats_frame(void)
+{
+	uint8_t frame[SC_PROTO_STATS_MAX_SIZE + 1] = {SC_PROTO_STATS_BYTE, 0x10, 4, 7, 0, 0, 0};
+	uint8_t diag[SC_PROTO_STATS_MAX_SIZE];
+	uint32_t age_ms;
+
+	zassert_equal(app_remote_proto_diag_get(&m_rx, diag, &age_ms), 0, NULL);
+
+	// Kept as is, without touching the sequence or the button state
+	zassert_ok(frame_send(10, 0, NULL, 0), NULL);
+	zassert_ok(app_remote_proto_decode(&m_rx, frame, 7), NULL);
+	zassert_equal(app_remote_proto_diag_get(&m_rx, diag, &age_ms), 6, NULL);
+	zassert_mem_equal(diag, &frame[1], 6, NULL);
+	zassert_equal(m_rx.stats.frames, 1, NULL);
+	zassert_equal(m_edge_count, 0, NULL);
+
+	zassert_ok(frame_send(11, 0, NULL, 0), NULL);
+	zassert_equal(m_rx.stats.lost_frames, 0, NULL);
+
+	zassert_equal(app_remote_proto_decode(&m_rx, frame, sizeof(frame)), -EINVAL, NULL);
+	zassert_equal(m_rx.stats.malformed, 1, NULL);
+
+	// Gone with the link
+	app_remote_proto_reset(&m_rx);
+	zassert_equal(app_remote_proto_diag_get(&m_rx, diag, &age_ms), 0, NULL);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(remote_protocol,
+			 ztest_unit_test_setup_teardown(test_legacy, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_malformed, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_events, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_seq_gap, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_resync, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_duplicate_edges, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_reset, setup, unit_test_noop),
+			 ztest_unit_test_setup_teardown(test_stats_frame, setup, unit_test_noop));
+	ztest_run_test_suite(remote_protocol);
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <ztest.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/byteorder.h>
+
+#include <sc_hid.h>
+
+#include "app_hid_capture.h"
+#include "app_latency.h"
+#include "app_usb_hid.h"
+
+#define EP_KBD		0
+#define EP_CONS_CTRL	1
+#define MAX_REPORTS	8
+#define REPORT_MAX_SIZE	16
+
+// Offset of the key array in a keyboard report: report ID, flags, padding
+#define KBD_KEYS_OFFSET	3
+
+// Stand-in for the HID IN endpoints. Reports are kept until the test plays
+// the host and reads them.
+static struct {
+	uint8_t data[MAX_REPORTS][REPORT_MAX_SIZE];
+	int count;
+	bool busy;
+} m_eps[APP_HID_CAPTURE_EP_COUNT];
+
+static app_hid_capture_ready_t m_in_ready;
+
+void app_hid_capture_init(app_hid_capture_ready_t in_ready_cb)
+{
+	m_in_ready = in_ready_cb;
+}
+
+int app_hid_capture_write(uint8_t ep, const uint8_t *data, uint32_t size, uint32_t *bytes_ret)
+{
+	zassert_true(ep < APP_HID_CAPTURE_EP_COUNT, NULL);
+	zassert_false(m_eps[ep].busy, "Write to a busy endpoint");
+	zassert_true(m_eps[ep].count < MAX_REPORTS, "Too many reports");
+	zassert_true(size <= REPORT_MAX_SIZE, NULL);
+
+	memcpy(m_eps[ep].data[m_eps[ep].count++], data, size);
+	m_eps[ep].busy = true;
+	*bytes_ret = size;
+	return 0;
+}
+
+// The host reads the endpoint, and the TX thread gets to send what it holds
+static void host_read(uint8_t ep)
+{
+	zassert_true(m_eps[ep].busy, "Nothing to read");
+
+	m_eps[ep].busy = false;
+	m_in_ready(ep);
+	k_sleep(K_MSEC(1));
+}
+
+static int kbd_send(const uint8_t *keys, int count)
+{
+	uint32_t key_bitmap[APP_USB_HID_KEY_BITMAP_WORDS] = {0};
+
+	for (int i = 0; i < count; i++) {
+		key_bitmap[keys[i] / 32] |= BIT(keys[i] % 32);
+	}
+	return app_usb_hid_send_kbd_state(APP_LATENCY_SOURCE_NONE, 0, key_bitmap);
+}
+
+// Keys in ascending order, as the report lists them
+static void assert_kbd_report(int index, const uint8_t *keys, int count)
+{
+	const uint8_t *report = m_eps[EP_KBD].data[index];
+
+	zassert_true(index < m_eps[EP_KBD].count, "Report %d missing", index);
+	zassert_equal(report[0], SC_HID_REPORT_ID_KBD, NULL);
+	for (int i = 0; i < SC_HID_KBD_ROLLOVER; i++) {
+		zassert_equal(report[KBD_KEYS_OFFSET + i], (i < count) ? keys[i] : 0,
+			      "Report %d, key %d", index, i);
+	}
+}
+
+static void setup(void)
+{
+	memset(m_eps, 0, sizeof(m_eps));
+}
+
+// Leave both endpoints idle for the next test, even after a failure
+static void teardown(void)
+{
+	for (int i = 0; (i < MAX_REPORTS) && app_usb_hid_wait_idle(10); i++) {
+		for (uint8_t ep = 0; ep < APP_HID_CAPTURE_EP_COUNT; ep++) {
+			if (m_eps[ep].busy) {
+				host_read(ep);
+			}
+		}
+	}
+}
+
+// The capture backend stands in for USB, so the endpoints are ready right away
+static void test_init(void)
+{
+	zassert_ok(app_usb_hid_init(), NULL);
+	zassert_not_null(m_in_ready, NULL);
+}
+
+static void test_direct(void)
+{
+	const uint8_t keys[] = {KEY_A};
+	struct app_usb_hid_stats before, after;
+
+	app_usb_hid_stats_get(&before);
+
+	// The endpoint is idle, the report is written from the caller
+	zassert_ok(kbd_send(keys, ARRAY_SIZE(keys)), NULL);
+	zassert_equal(m_eps[EP_KBD].count, 1, NULL);
+	assert_kbd_report(0, keys, ARRAY_SIZE(keys));
+
+	app_usb_hid_stats_get(&after);
+	zassert_equal(after.direct - before.direct, 1, NULL);
+	zassert_equal(after.queued - before.queued, 0, NULL);
+
+	host_read(EP_KBD);
+	zassert_ok(app_usb_hid_wait_idle(10), NULL);
+}
+
+static void test_coalesce(void)
+{
+	const uint8_t keys[] = {KEY_A, KEY_B, KEY_C};
+	struct app_usb_hid_stats before, after;
+
+	app_usb_hid_stats_get(&before);
+
+	// Each report only adds a key, so the last one tells the host everything
+	zassert_ok(kbd_send(keys, 1), NULL);
+	zassert_ok(kbd_send(keys, 2), NULL);
+	zassert_ok(kbd_send(keys, 3), NULL);
+	k_sleep(K_MSEC(1));
+	zassert_equal(m_eps[EP_KBD].count, 1, "Report written to a busy endpoint");
+
+	host_read(EP_KBD);
+	zassert_equal(m_eps[EP_KBD].count, 2, NULL);
+	assert_kbd_report(1, keys, 3);
+
+	app_usb_hid_stats_get(&after);
+	zassert_equal(after.queued - before.queued, 2, NULL);
+	zassert_equal(after.coalesced - before.coalesced, 1, NULL);
+	zassert_equal(after.dropped - before.dropped, 0, NULL);
+
+	host_read(EP_KBD);
+	zassert_ok(app_usb_hid_wait_idle(10), NULL);
+}
+
+static void test_no_coalesce_double_change(void)
+{
+	const uint8_t held[] = {KEY_B};
+	const uint8_t tap[] = {KEY_A, KEY_B};
+	struct app_usb_hid_stats before, after;
+
+	app_usb_hid_stats_get(&before);
+
+	// A pressed and released behind a busy endpoint, the press must be seen
+	zassert_ok(kbd_send(held, ARRAY_SIZE(held)), NULL);
+	zassert_ok(kbd_send(tap, ARRAY_SIZE(tap)), NULL);
+	zassert_ok(kbd_send(held, ARRAY_SIZE(held)), NULL);
+
+	host_read(EP_KBD);
+	host_read(EP_KBD);
+	zassert_equal(m_eps[EP_KBD].count, 3, NULL);
+	assert_kbd_report(0, held, ARRAY_SIZE(held));
+	assert_kbd_report(1, tap, ARRAY_SIZE(tap));
+	assert_kbd_report(2, held, ARRAY_SIZE(held));
+
+	app_usb_hid_stats_get(&after);
+	zassert_equal(after.coalesced - before.coalesced, 0, NULL);
+
+	host_read(EP_KBD);
+	zassert_ok(app_usb_hid_wait_idle(10), NULL);
+}
+
+static void test_ifaces_independent(void)
+{
+	const uint8_t keys[] = {KEY_A};
+	const uint16_t usage = SC_HID_CONS_VOLUME_UP;
+	struct app_usb_hid_stats before, after;
+
+	app_usb_hid_stats_get(&before);
+
+	// A busy keyboard endpoint does not hold back consumer control
+	zassert_ok(kbd_send(keys, ARRAY_SIZE(keys)), NULL);
+	zassert_ok(app_usb_hid_send_cons_ctrl_state(APP_LATENCY_SOURCE_NONE, &usage, 1), NULL);
+	zassert_equal(m_eps[EP_CONS_CTRL].count, 1, NULL);
+	zassert_equal(m_eps[EP_CONS_CTRL].data[0][0], SC_HID_REPORT_ID_CONS_CTRL, NULL);
+	zassert_equal(sys_get_le16(&m_eps[EP_CONS_CTRL].data[0][1]), usage, NULL);
+
+	app_usb_hid_stats_get(&after);
+	zassert_equal(after.direct - before.direct, 2, NULL);
+
+	zassert_equal(app_usb_hid_send_cons_ctrl_state(APP_LATENCY_SOURCE_NONE, &usage,
+						       SC_HID_CONS_CTRL_SLOTS + 1),
+		      -EINVAL, NULL);
+
+	host_read(EP_KBD);
+	host_read(EP_CONS_CTRL);
+	zassert_ok(app_usb_hid_wait_idle(10), NULL);
+}
+
+void test_main(void)
+{
+	ztest_test_suite(usb_hid,
+			 ztest_unit_test(test_init),
+			 ztest_unit_test_setup_teardown(test_direct, setup, teardown),
+			 ztest_unit_test_setup_teardown(test_coalesce, setup, teardown),
+			 ztest_unit_test_setup_teardown(test_no_coalesce_double_change,
+							setup, teardown),
+			 ztest_unit_test_setup_teardown(test_ifaces_independent, setup, teardown));
+	ztest_run_test_suite(usb_hid);
+}